@@ -0,0 +1,874 @@
+#include "sptl.h"
+#include <threads.h>
+#include <time.h>
+
+static volatile uint64_t sptl_bench_sink;
+
+static double sptl_bench_now(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+static void sptl_bench_hash(size_t key_len) {
+    const size_t keys = 1024;
+    const size_t total_bytes = (size_t) 1 << 28;
+    const size_t rounds = total_bytes / (keys * key_len) + 1;
+
+    char *buf = malloc(keys * key_len);
+    assert(buf);
+    for (size_t i = 0; i < keys * key_len; ++i) {
+        buf[i] = (char) ('!' + (i * 31 + i / 7) % 90);
+    }
+
+    uint64_t acc = 0;
+    double start = sptl_bench_now();
+    for (size_t r = 0; r < rounds; ++r) {
+        for (size_t i = 0; i < keys; ++i) {
+            const char *key = buf + i * key_len;
+            acc += hash_fnv(&key, key_len);
+        }
+    }
+    const double fnv = sptl_bench_now() - start;
+
+    start = sptl_bench_now();
+    for (size_t r = 0; r < rounds; ++r) {
+        for (size_t i = 0; i < keys; ++i) {
+            acc += sp_hash_bytes(buf + i * key_len, key_len, 0);
+        }
+    }
+    const double fast = sptl_bench_now() - start;
+
+    sptl_bench_sink = acc;
+    free(buf);
+
+    const double hashes = (double) (rounds * keys);
+    sp_log(SP_INFO, "hash %5zu B keys: hash_fnv %7.2f ns/key (%6.2f GB/s), sp_hash_bytes %7.2f ns/key (%6.2f GB/s)",
+           key_len, fnv * 1e9 / hashes, hashes * (double) key_len / fnv * 1e-9, fast * 1e9 / hashes,
+           hashes * (double) key_len / fast * 1e-9);
+}
+
+/* Sp_Queue push/peek as they were before switching to masks: head/tail mapped onto slots with `%`. */
+#define sptl_bench_mod_queue_push(queue, element)                                           \
+    do {                                                                                    \
+        sp_queue_reserve((queue), !(queue)->data ? SP_QUEUE_INIT_CAP : (queue)->count + 1); \
+        (queue)->data[(queue)->tail++ % (queue)->capacity] = (element);                     \
+        ++(queue)->count;                                                                   \
+    } while (0)
+#define sptl_bench_mod_queue_peek(queue) \
+    ((queue)->count == 0 ? ((__typeof__(*(queue)->data)) {0}) : (queue)->data[(queue)->head % (queue)->capacity])
+
+static void sptl_bench_queue(void) {
+    const size_t rounds = (size_t) 1 << 20;
+    const size_t batch = 48;
+    uint64_t acc = 0;
+
+    Sp_Queue(int) queue = {0};
+    double start = sptl_bench_now();
+    for (size_t r = 0; r < rounds; ++r) {
+        for (size_t i = 0; i < batch; ++i) {
+            sp_queue_push(&queue, (int) i);
+        }
+        for (size_t i = 0; i < batch; ++i) {
+            acc += (uint64_t) sp_queue_peek(&queue);
+            sp_queue_pop(&queue);
+        }
+    }
+    const double masked = sptl_bench_now() - start;
+    sp_queue_free(&queue);
+
+    start = sptl_bench_now();
+    for (size_t r = 0; r < rounds; ++r) {
+        for (size_t i = 0; i < batch; ++i) {
+            sptl_bench_mod_queue_push(&queue, (int) i);
+        }
+        for (size_t i = 0; i < batch; ++i) {
+            acc += (uint64_t) sptl_bench_mod_queue_peek(&queue);
+            sp_queue_pop(&queue);
+        }
+    }
+    const double modulo = sptl_bench_now() - start;
+    sp_queue_free(&queue);
+
+    int items[48], out[48];
+    for (size_t i = 0; i < batch; ++i) {
+        items[i] = (int) i;
+    }
+    start = sptl_bench_now();
+    for (size_t r = 0; r < rounds; ++r) {
+        size_t popped;
+        items[r % batch] = (int) r;
+        sp_queue_push_n(&queue, items, batch);
+        sp_queue_pop_n(&queue, out, batch, &popped);
+        acc += (uint64_t) out[r % popped];
+    }
+    const double bulk = sptl_bench_now() - start;
+    sp_queue_free(&queue);
+
+    sptl_bench_sink = acc;
+    const double ops = (double) (rounds * batch * 2);
+    sp_log(SP_INFO, "Sp_Queue(int) push/pop: mask %.2f ns/op, modulo %.2f ns/op, push_n/pop_n(48) %.2f ns/op",
+           masked * 1e9 / ops, modulo * 1e9 / ops, bulk * 1e9 / ops);
+}
+
+/* Producer/consumer hand-off through the lock-free rings and through an Sp_Queue behind a mutex, bounded alike. */
+#define SPTL_BENCH_RING_ITEMS ((uint64_t) 1 << 21)
+#define SPTL_BENCH_RING_CAPACITY 1024
+
+typedef enum {
+    SPTL_BENCH_SPSC,
+    SPTL_BENCH_MPMC,
+    SPTL_BENCH_MUTEX,
+} sptl_bench_ring_kind;
+
+static Sp_Spsc_Ring(uint64_t) sptl_bench_spsc;
+static Sp_Mpmc_Ring(uint64_t) sptl_bench_mpmc;
+static struct {
+    mtx_t lock;
+    Sp_Queue(uint64_t) queue;
+} sptl_bench_locked;
+static sptl_bench_ring_kind sptl_bench_ring_mode;
+static size_t sptl_bench_ring_batch;
+static uint64_t sptl_bench_ring_total;
+static atomic_uint_least64_t sptl_bench_ring_popped;
+
+static int sptl_bench_ring_producer(void *arg) {
+    const uint64_t base = (uint64_t) (uintptr_t) arg * SPTL_BENCH_RING_ITEMS;
+    uint64_t batch[64];
+    for (uint64_t i = 0; i < SPTL_BENCH_RING_ITEMS;) {
+        const size_t n = SPTL_BENCH_RING_ITEMS - i < sptl_bench_ring_batch ? (size_t) (SPTL_BENCH_RING_ITEMS - i)
+                                                                            : sptl_bench_ring_batch;
+        for (size_t k = 0; k < n; ++k) {
+            batch[k] = base + i + k;
+        }
+        size_t pushed = 0;
+        switch (sptl_bench_ring_mode) {
+            case SPTL_BENCH_SPSC:
+                sp_spsc_ring_push_n(&sptl_bench_spsc, batch, n, &pushed);
+                break;
+            case SPTL_BENCH_MPMC:
+                sp_mpmc_ring_push_n(&sptl_bench_mpmc, batch, n, &pushed);
+                break;
+            case SPTL_BENCH_MUTEX:
+                mtx_lock(&sptl_bench_locked.lock);
+                for (; pushed < n && sptl_bench_locked.queue.count < SPTL_BENCH_RING_CAPACITY; ++pushed) {
+                    sp_queue_push(&sptl_bench_locked.queue, batch[pushed]);
+                }
+                mtx_unlock(&sptl_bench_locked.lock);
+                break;
+        }
+        i += pushed;
+        if (!pushed) thrd_yield();
+    }
+    return 0;
+}
+
+static int sptl_bench_ring_consumer(void *arg) {
+    (void) arg;
+    uint64_t out[64], acc = 0;
+    while (atomic_load_explicit(&sptl_bench_ring_popped, memory_order_relaxed) < sptl_bench_ring_total) {
+        size_t popped = 0;
+        switch (sptl_bench_ring_mode) {
+            case SPTL_BENCH_SPSC:
+                sp_spsc_ring_pop_n(&sptl_bench_spsc, out, sptl_bench_ring_batch, &popped);
+                break;
+            case SPTL_BENCH_MPMC:
+                sp_mpmc_ring_pop_n(&sptl_bench_mpmc, out, sptl_bench_ring_batch, &popped);
+                break;
+            case SPTL_BENCH_MUTEX:
+                mtx_lock(&sptl_bench_locked.lock);
+                for (; popped < sptl_bench_ring_batch && sptl_bench_locked.queue.count > 0; ++popped) {
+                    out[popped] = sp_queue_peek(&sptl_bench_locked.queue);
+                    sp_queue_pop(&sptl_bench_locked.queue);
+                }
+                mtx_unlock(&sptl_bench_locked.lock);
+                break;
+        }
+        for (size_t k = 0; k < popped; ++k) {
+            acc += out[k];
+        }
+        atomic_fetch_add_explicit(&sptl_bench_ring_popped, popped, memory_order_relaxed);
+        if (!popped) thrd_yield();
+    }
+    sptl_bench_sink = acc;
+    return 0;
+}
+
+static void sptl_bench_ring(sptl_bench_ring_kind mode, const char *name, size_t threads, size_t batch) {
+    sptl_bench_ring_mode = mode;
+    sptl_bench_ring_batch = batch;
+    sptl_bench_ring_total = threads * SPTL_BENCH_RING_ITEMS;
+    atomic_store(&sptl_bench_ring_popped, 0);
+    sp_spsc_ring_init(&sptl_bench_spsc, SPTL_BENCH_RING_CAPACITY);
+    sp_mpmc_ring_init(&sptl_bench_mpmc, SPTL_BENCH_RING_CAPACITY);
+    mtx_init(&sptl_bench_locked.lock, mtx_plain);
+    sp_queue_reserve(&sptl_bench_locked.queue, SPTL_BENCH_RING_CAPACITY);
+
+    thrd_t producers[4], consumers[4];
+    const double start = sptl_bench_now();
+    for (size_t i = 0; i < threads; ++i) {
+        thrd_create(&producers[i], sptl_bench_ring_producer, (void *) (uintptr_t) i);
+        thrd_create(&consumers[i], sptl_bench_ring_consumer, NULL);
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        thrd_join(producers[i], NULL);
+        thrd_join(consumers[i], NULL);
+    }
+    const double elapsed = sptl_bench_now() - start;
+
+    sp_log(SP_INFO, "%-22s %zuP/%zuC batch %2zu: %7.2f M items/s", name, threads, threads, batch,
+           (double) sptl_bench_ring_total / elapsed * 1e-6);
+
+    sp_spsc_ring_free(&sptl_bench_spsc);
+    sp_mpmc_ring_free(&sptl_bench_mpmc);
+    mtx_destroy(&sptl_bench_locked.lock);
+    sp_queue_free(&sptl_bench_locked.queue);
+}
+
+static void sptl_bench_ht(size_t n) {
+    Sp_String_Builder keys = {0};
+    sp_da_reserve(&keys, n * 32); // views point into keys, so it must not move
+    Sp_Dynamic_Array(Sp_String_View) views = {0};
+    sp_da_reserve(&views, n);
+    for (size_t i = 0; i < n; ++i) {
+        const size_t begin = keys.count;
+        sp_sb_appendf(&keys, "key:%zu", i * 2654435761u);
+        sp_da_push(&views, ((Sp_String_View) {.ptr = keys.data + begin, .count = keys.count - begin}));
+    }
+
+    Sp_Hash_Table(Sp_String_View, int) ht = {0};
+    sp_ht_node_t(&ht) *node = NULL;
+    uint64_t acc = 0;
+    const size_t rounds = n < 1000000 ? 1000000 / n : 1;
+
+    double start = sptl_bench_now();
+    for (size_t r = 0; r < rounds; ++r) {
+        sp_ht_free(&ht);
+        for (size_t i = 0; i < n; ++i) {
+            sp_ht_insert(&ht, views.data[i], (int) i);
+        }
+    }
+    const double insert = sptl_bench_now() - start;
+
+    start = sptl_bench_now();
+    for (size_t r = 0; r < 4 * rounds; ++r) {
+        for (size_t i = 0; i < n; ++i) {
+            sp_ht_get(&ht, views.data[(i * 7919) % n], &node);
+            acc += (uint64_t) node->value;
+        }
+    }
+    const double get = sptl_bench_now() - start;
+
+    // Slot index computation alone, over the table's own hashes: `%` versus the mask the table uses.
+    volatile size_t volatile_capacity = ht.table.capacity;
+    const size_t capacity = volatile_capacity;
+    start = sptl_bench_now();
+    for (size_t i = 0; i < n; ++i) {
+        acc += sp_sv_hash(&views.data[i], 0) % capacity;
+    }
+    const double modulo = sptl_bench_now() - start;
+    start = sptl_bench_now();
+    for (size_t i = 0; i < n; ++i) {
+        acc += sp_sv_hash(&views.data[i], 0) & (capacity - 1);
+    }
+    const double masked = sptl_bench_now() - start;
+
+    sptl_bench_sink = acc;
+    sp_log(SP_INFO,
+           "Sp_Hash_Table(Sp_String_View, int) n=%zu: insert %.2f ns/op, get %.2f ns/op; "
+           "hash+index: modulo %.2f ns/op, mask %.2f ns/op",
+           n, insert * 1e9 / (double) (rounds * n), get * 1e9 / (double) (4 * rounds * n), modulo * 1e9 / (double) n,
+           masked * 1e9 / (double) n);
+
+    sp_ht_free(&ht);
+    sp_da_free(&views);
+    sp_da_free(&keys);
+}
+
+/* Dispatch-table style lookups of constant keys: re-measured and re-hashed views versus pre-hashed keys. */
+static void sptl_bench_ht_literal_keys(void) {
+    static const char *const names[] = {"listen_address", "port", "worker_threads", "log_level", "max_connections",
+                                        "timeout_ms", "tls_certificate", "tls_key"};
+    const size_t n = sizeof(names) / sizeof(*names);
+    const size_t rounds = (size_t) 1 << 22;
+    uint64_t acc = 0;
+
+    Sp_Hash_Table(Sp_String_View, int) by_view = {0};
+    Sp_Hash_Table(Sp_Hashed_View, int) by_hash = {0};
+    Sp_Hashed_View keys[sizeof(names) / sizeof(*names)];
+    for (size_t i = 0; i < n; ++i) {
+        keys[i] = sp_hashed_view(sp_cstr_slice(names[i]));
+        sp_ht_insert(&by_view, keys[i].sv, (int) i);
+        sp_ht_insert(&by_hash, keys[i], (int) i);
+    }
+
+    int *value;
+    double start = sptl_bench_now();
+    for (size_t r = 0; r < rounds; ++r) {
+        sp_ht_find(&by_view, sp_cstr_slice(names[r % n]), &value);
+        acc += (uint64_t) *value;
+    }
+    const double view = sptl_bench_now() - start;
+
+    start = sptl_bench_now();
+    for (size_t r = 0; r < rounds; ++r) {
+        sp_ht_find(&by_hash, keys[r % n], &value);
+        acc += (uint64_t) *value;
+    }
+    const double hashed = sptl_bench_now() - start;
+
+    sptl_bench_sink = acc;
+    sp_log(SP_INFO, "literal key lookups: sp_cstr_slice %.2f ns/op, Sp_Hashed_View %.2f ns/op",
+           view * 1e9 / (double) rounds, hashed * 1e9 / (double) rounds);
+
+    sp_ht_free(&by_view);
+    sp_ht_free(&by_hash);
+}
+
+static void sptl_bench_list_traversal(size_t n) {
+    const size_t rounds = 20;
+    uint64_t acc = 0;
+
+    Sp_Dynamic_Array(int) da = {0};
+    Sp_Linked_List(int) ll = {0};
+    Sp_Unrolled_List(int) ul = {0};
+    for (size_t i = 0; i < n; ++i) {
+        sp_da_push(&da, (int) i);
+        sp_ll_push_back(&ll, (int) i);
+        sp_ul_push_back(&ul, (int) i);
+    }
+
+    double start = sptl_bench_now();
+    for (size_t r = 0; r < rounds; ++r) {
+        for (size_t i = 0; i < da.count; ++i) {
+            acc += (uint64_t) da.data[i];
+        }
+    }
+    const double array = sptl_bench_now() - start;
+
+    start = sptl_bench_now();
+    for (size_t r = 0; r < rounds; ++r) {
+        for (sp_ll_node *node = ll.head; node; node = node->next) {
+            acc += (uint64_t) *sp_ll_node_unwrap(&ll, node);
+        }
+    }
+    const double linked = sptl_bench_now() - start;
+
+    start = sptl_bench_now();
+    for (size_t r = 0; r < rounds; ++r) {
+        for (sp_ul_node *node = ul.head; node; node = node->next) {
+            for (size_t i = node->begin; i < node->end; ++i) {
+                acc += (uint64_t) sp_ul_node_data(&ul, node)[i];
+            }
+        }
+    }
+    const double unrolled = sptl_bench_now() - start;
+
+    sptl_bench_sink = acc;
+    const double ops = (double) (rounds * n);
+    sp_log(SP_INFO, "traverse %zu ints: Sp_Dynamic_Array %.2f ns/elem, Sp_Linked_List %.2f ns/elem, "
+           "Sp_Unrolled_List %.2f ns/elem", n, array * 1e9 / ops, linked * 1e9 / ops, unrolled * 1e9 / ops);
+
+    sp_da_free(&da);
+    sp_ll_free(&ll);
+    sp_ul_free(&ul);
+}
+
+static void sptl_bench_format(void) {
+    const size_t n = (size_t) 1 << 20;
+    uint64_t *ints = malloc(n * sizeof(*ints));
+    double *doubles = malloc(n * sizeof(*doubles));
+    assert(ints && doubles);
+    uint64_t x = 0x9E3779B97F4A7C15u;
+    for (size_t i = 0; i < n; ++i) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        ints[i] = x >> (x & 63); // spread over all digit counts
+        doubles[i] = (double) (x >> 11) * 0x1.0p-53 * 1e6;
+    }
+
+    Sp_String_Builder sb = {0};
+    sp_da_reserve(&sb, 64);
+    char buf[64];
+    uint64_t acc = 0;
+
+    double start = sptl_bench_now();
+    for (size_t i = 0; i < n; ++i) {
+        acc += (uint64_t) snprintf(buf, sizeof(buf), "%llu", (unsigned long long) ints[i]);
+    }
+    const double uint_printf = sptl_bench_now() - start;
+
+    start = sptl_bench_now();
+    for (size_t i = 0; i < n; ++i) {
+        sb.count = 0;
+        sp_sb_append_uint(&sb, ints[i]);
+        acc += sb.count;
+    }
+    const double uint_sp = sptl_bench_now() - start;
+
+    start = sptl_bench_now();
+    for (size_t i = 0; i < n; ++i) {
+        acc += (uint64_t) snprintf(buf, sizeof(buf), "%.17g", doubles[i]);
+    }
+    const double double_printf = sptl_bench_now() - start;
+
+    start = sptl_bench_now();
+    for (size_t i = 0; i < n; ++i) {
+        sb.count = 0;
+        sp_sb_append_double(&sb, doubles[i]);
+        acc += sb.count;
+    }
+    const double double_sp = sptl_bench_now() - start;
+
+    sptl_bench_sink = acc;
+    sp_log(SP_INFO, "format uint64: snprintf %.2f ns/op, sp_sb_append_uint %.2f ns/op", uint_printf * 1e9 / (double) n,
+           uint_sp * 1e9 / (double) n);
+    sp_log(SP_INFO, "format double: snprintf(%%.17g) %.2f ns/op, sp_sb_append_double %.2f ns/op",
+           double_printf * 1e9 / (double) n, double_sp * 1e9 / (double) n);
+
+    sp_da_free(&sb);
+    free(ints);
+    free(doubles);
+}
+
+static void sptl_bench_sv(void) {
+    const size_t size = (size_t) 1 << 24;
+    const size_t rounds = 8;
+    char *buf = malloc(size);
+    assert(buf);
+    for (size_t i = 0; i < size; ++i) {
+        buf[i] = (char) ('a' + (i * 7 + i / 13) % 26);
+    }
+    for (size_t i = 63; i < size; i += 64) {
+        buf[i] = ','; // CSV-like field lengths
+    }
+    const Sp_String_View sv = {.ptr = buf, .count = size};
+    const Sp_String_View needle = sp_cstr_slice("needle in haystack");
+    uint64_t acc = 0;
+
+    double start = sptl_bench_now();
+    for (size_t r = 0; r < rounds; ++r) {
+        acc += sp_sv_find_char(&sv, (char) ('#' + r % 2)); // neither occurs
+    }
+    const double find_char = sptl_bench_now() - start;
+
+    start = sptl_bench_now();
+    for (size_t r = 0; r < rounds; ++r) {
+        acc += (uint64_t) (uintptr_t) memchr(buf, '#' + (int) (r % 2), size);
+    }
+    const double libc_memchr = sptl_bench_now() - start;
+
+    start = sptl_bench_now();
+    for (size_t r = 0; r < rounds; ++r) {
+        acc += sp_sv_find(&sv, &needle);
+    }
+    const double find = sptl_bench_now() - start;
+
+    // Naive reference: memchr for the first byte, then memcmp.
+    start = sptl_bench_now();
+    for (size_t r = 0; r < rounds; ++r) {
+        for (size_t i = 0; i + needle.count <= size; ++i) {
+            const char *hit = memchr(buf + i, needle.ptr[0], size - needle.count + 1 - i);
+            if (!hit) {
+                break;
+            }
+            i = (size_t) (hit - buf);
+            if (!memcmp(hit, needle.ptr, needle.count)) {
+                acc += i;
+                break;
+            }
+        }
+    }
+    const double naive = sptl_bench_now() - start;
+
+    start = sptl_bench_now();
+    for (size_t r = 0; r < rounds; ++r) {
+        Sp_String_View rest = sv, field;
+        while (sp_sv_split_next(&rest, ',', &field)) {
+            acc += field.count;
+        }
+    }
+    const double split = sptl_bench_now() - start;
+
+    sptl_bench_sink = acc;
+    const double bytes = (double) (rounds * size);
+    sp_log(SP_INFO, "sv 16 MiB scan: sp_sv_find_char %.2f GB/s, memchr %.2f GB/s", bytes / find_char * 1e-9,
+           bytes / libc_memchr * 1e-9);
+    sp_log(SP_INFO,
+           "sv 16 MiB scan: sp_sv_find %.2f GB/s, memchr+memcmp %.2f GB/s, "
+           "sp_sv_split_next(64 B fields) %.2f GB/s",
+           bytes / find * 1e-9, bytes / naive * 1e-9, bytes / split * 1e-9);
+
+    free(buf);
+}
+
+static void sptl_bench_bitset(void) {
+    const size_t nbits = (size_t) 1 << 24;
+    const size_t rounds = 16;
+    Sp_Bitset mask = {0}, filter = {0};
+    sp_bitset_reserve(&mask, nbits);
+    sp_bitset_reserve(&filter, nbits);
+    uint64_t x = 0x9E3779B97F4A7C15u;
+    for (size_t i = 0; i < mask.bits.count; ++i) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        mask.bits.data[i] = x;
+        filter.bits.data[i] = x & (x >> 3) & (x >> 5) & (x >> 9); // ~1/16 density
+    }
+    uint64_t acc = 0;
+
+    // Reference: one sp_bitset_check() per row, as filtering had to be done before bulk operations.
+    double start = sptl_bench_now();
+    for (size_t i = 0; i < nbits; ++i) {
+        acc += (uint64_t) (sp_bitset_check(&mask, i) & sp_bitset_check(&filter, i));
+    }
+    const double per_bit = sptl_bench_now() - start;
+
+    start = sptl_bench_now();
+    for (size_t r = 0; r < rounds; ++r) {
+        sp_bitset_and(&mask, &filter);
+        acc += sp_bitset_count(&mask);
+    }
+    const double bulk = (sptl_bench_now() - start) / (double) rounds;
+
+    start = sptl_bench_now();
+    for (size_t i = sp_bitset_find_first(&filter); i != SP_BITSET_NPOS; i = sp_bitset_find_next(&filter, i + 1)) {
+        acc += i;
+    }
+    const double iterate = sptl_bench_now() - start;
+
+    sptl_bench_sink = acc;
+    sp_log(SP_INFO,
+           "Sp_Bitset 16M rows: per-bit check AND %.2f ms, bulk and+count %.2f ms, "
+           "find_next over ~1M rows %.2f ms",
+           per_bit * 1e3, bulk * 1e3, iterate * 1e3);
+
+    sp_bitset_free(&mask);
+    sp_bitset_free(&filter);
+}
+
+static void sptl_bench_bloom(double fpr) {
+    const size_t n = 1000000;
+    Sp_Bloom bloom = {0};
+    sp_bloom_init(&bloom, n, fpr);
+
+    double start = sptl_bench_now();
+    for (uint64_t i = 0; i < n; ++i) {
+        sp_bloom_add_hash(&bloom, sp_hash_u64(i, 0));
+    }
+    const double add = sptl_bench_now() - start;
+
+    // Keys never added: every hit is a false positive. Probe enough of them to expect ~100 hits at the target.
+    const size_t probes = (size_t) (100 / fpr) > n ? (size_t) (100 / fpr) : n;
+    size_t hits = 0;
+    start = sptl_bench_now();
+    for (uint64_t i = n; i < n + probes; ++i) {
+        hits += (size_t) sp_bloom_contains_hash(&bloom, sp_hash_u64(i, 0));
+    }
+    const double query = sptl_bench_now() - start;
+
+    sptl_bench_sink = hits;
+    sp_log(SP_INFO, "Sp_Bloom 1M keys, target fpr %.0e: observed %.2e, %.1f bits/key, k %u, add %.1f ns, query %.1f ns",
+           fpr, (double) hits / (double) probes, (double) (bloom.blocks * SP_BLOOM_BLOCK_BITS) / (double) n, bloom.k,
+           add / (double) n * 1e9, query / (double) probes * 1e9);
+
+    sp_bloom_free(&bloom);
+}
+
+static void sptl_bench_roaring(void) {
+    const size_t n = 1000000;
+    Sp_Roaring a = {0}, b = {0};
+    uint64_t x = 0x9E3779B97F4A7C15u;
+    for (size_t i = 0; i < n; ++i) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        sp_roaring_add(&a, (uint32_t) x);
+        sp_roaring_add(&b, (uint32_t) (x >> 32));
+    }
+    // Dense band shared by both so the intersection has bitmap containers to work on
+    for (uint32_t i = 0; i < 1u << 22; i += 3) {
+        sp_roaring_add(&a, i);
+        sp_roaring_add(&b, i + (i & 1));
+    }
+
+    size_t bytes = a.containers.count * sizeof(*a.containers.data);
+    for (size_t i = 0; i < a.containers.count; ++i) {
+        bytes += __sp_roaring_container_bytes(&a.containers.data[i]);
+    }
+    uint64_t acc = 0;
+
+    double start = sptl_bench_now();
+    Sp_Roaring_Iter it = sp_roaring_iter(&a);
+    uint32_t value;
+    while (sp_roaring_iter_next(&it, &value)) {
+        acc += value;
+    }
+    const double iterate = sptl_bench_now() - start;
+
+    start = sptl_bench_now();
+    sp_roaring_and(&a, &b);
+    acc += sp_roaring_cardinality(&a);
+    const double intersect = sptl_bench_now() - start;
+
+    sptl_bench_sink = acc;
+    sp_log(SP_INFO,
+           "Sp_Roaring ~2.4M ids over 32 bits: %.1f MiB (flat bitset 512 MiB), iterate %.2f ms, "
+           "and+cardinality %.2f ms",
+           (double) bytes / (1 << 20), iterate * 1e3, intersect * 1e3);
+
+    sp_roaring_free(&a);
+    sp_roaring_free(&b);
+}
+
+static void sptl_bench_heap(void) {
+    const size_t n = 1000000, k = 100;
+    Sp_Dynamic_Array(int) values = {0};
+    uint64_t x = 0x9E3779B97F4A7C15u;
+    for (size_t i = 0; i < n; ++i) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        sp_da_push(&values, (int) (x >> 33));
+    }
+    uint64_t acc = 0;
+
+    Sp_Heap(int) heap = {0};
+    double start = sptl_bench_now();
+    for (size_t i = 0; i < n; ++i) {
+        sp_heap_push(&heap, values.data[i]);
+    }
+    const double pushes = sptl_bench_now() - start;
+    acc += (uint64_t) sp_heap_top(&heap);
+    sp_heap_free(&heap);
+
+    Sp_Dynamic_Array(int) copy = {0};
+    sp_da_reserve(&copy, n);
+    memcpy(copy.data, values.data, n * sizeof(int));
+    copy.count = n;
+    start = sptl_bench_now();
+    sp_heap_from_array(&heap, &copy);
+    const double floyd = sptl_bench_now() - start;
+    acc += (uint64_t) sp_heap_top(&heap);
+    sp_heap_free(&heap);
+
+    // Top-K of a drifting stream, so most values evict the top of the K-element min-heap
+    start = sptl_bench_now();
+    for (size_t i = 0; i < n; ++i) {
+        const int value = (int) (i + (size_t) values.data[i] % 4096);
+        if (heap.count < k) {
+            sp_heap_push(&heap, value);
+        } else if (value > sp_heap_top(&heap)) {
+            sp_heap_pop(&heap);
+            sp_heap_push(&heap, value);
+        }
+    }
+    const double pop_push = sptl_bench_now() - start;
+    acc += (uint64_t) sp_heap_top(&heap);
+    sp_heap_free(&heap);
+
+    start = sptl_bench_now();
+    for (size_t i = 0; i < n; ++i) {
+        const int value = (int) (i + (size_t) values.data[i] % 4096);
+        if (heap.count < k) {
+            sp_heap_push(&heap, value);
+        } else if (value > sp_heap_top(&heap)) {
+            sp_heap_replace_top(&heap, value);
+        }
+    }
+    const double replace = sptl_bench_now() - start;
+    acc += (uint64_t) sp_heap_top(&heap);
+    sp_heap_free(&heap);
+
+    sptl_bench_sink = acc;
+    sp_log(SP_INFO,
+           "Sp_Heap(int) 1M: push-by-one %.2f ms, from_array %.2f ms; top-100: pop+push %.2f ms, "
+           "replace_top %.2f ms",
+           pushes * 1e3, floyd * 1e3, pop_push * 1e3, replace * 1e3);
+
+    sp_da_free(&values);
+}
+
+typedef struct {
+    uint64_t deadline;
+    uint64_t id;
+} sptl_bench_timer;
+
+static int sptl_bench_timer_cmp(sptl_bench_timer a, sptl_bench_timer b) {
+    return a.deadline < b.deadline;
+}
+#define sptl_bench_timer_earlier(a, b) ((a).deadline < (b).deadline)
+
+// Read through a volatile, so the compiler cannot see the target and must call through the pointer
+static int (*volatile sptl_bench_timer_cmp_opaque)(sptl_bench_timer, sptl_bench_timer) = sptl_bench_timer_cmp;
+
+/* Hold model of a scheduler: pop the earliest timer, push it back with a later deadline. */
+#define sptl_bench_timer_hold(heap, n, push, pop, seconds_ptr)                        \
+    do {                                                                              \
+        uint64_t x = 0x9E3779B97F4A7C15u;                                             \
+        for (uint64_t i = 0; i < (n); ++i) {                                          \
+            x ^= x << 13;                                                             \
+            x ^= x >> 7;                                                              \
+            x ^= x << 17;                                                             \
+            push((heap), ((sptl_bench_timer) {.deadline = x % (1u << 30), .id = i})); \
+        }                                                                             \
+        const double start = sptl_bench_now();                                        \
+        for (uint64_t i = 0; i < (n); ++i) {                                          \
+            sptl_bench_timer timer = sp_heap_top(heap);                               \
+            pop(heap);                                                                \
+            x ^= x << 13;                                                             \
+            x ^= x >> 7;                                                              \
+            x ^= x << 17;                                                             \
+            timer.deadline += x % (1u << 20);                                         \
+            push((heap), timer);                                                      \
+        }                                                                             \
+        *(seconds_ptr) = sptl_bench_now() - start;                                    \
+        sptl_bench_sink = sp_heap_top(heap).deadline;                                 \
+        sp_heap_free(heap);                                                           \
+    } while (0)
+
+#define sptl_bench_timer_push_by(heap, timer) sp_heap_push_by((heap), (timer), sptl_bench_timer_earlier)
+#define sptl_bench_timer_pop_by(heap) sp_heap_pop_by((heap), sptl_bench_timer_earlier)
+
+static void sptl_bench_heap_timers(void) {
+    const size_t n = 1000000;
+    double pointer, inlined, quaternary;
+
+    Sp_Heap(sptl_bench_timer) binary = {.cmp = sptl_bench_timer_cmp_opaque};
+    sptl_bench_timer_hold(&binary, n, sp_heap_push, sp_heap_pop, &pointer);
+    sptl_bench_timer_hold(&binary, n, sptl_bench_timer_push_by, sptl_bench_timer_pop_by, &inlined);
+    Sp_Heap_D(sptl_bench_timer, 4) wide = {0};
+    sptl_bench_timer_hold(&wide, n, sptl_bench_timer_push_by, sptl_bench_timer_pop_by, &quaternary);
+
+    const double ops = (double) n;
+    sp_log(SP_INFO, "Sp_Heap 1M timers pop+push: cmp pointer %.1f ns, inlined %.1f ns, 4-ary inlined %.1f ns",
+           pointer * 1e9 / ops, inlined * 1e9 / ops, quaternary * 1e9 / ops);
+}
+
+typedef struct {
+    uint64_t dist;
+    uint32_t vertex;
+} sptl_bench_hop;
+
+#define sptl_bench_hop_closer(a, b) ((a).dist < (b).dist)
+
+/* Dijkstra over a random graph, lazily pushing duplicates and skipping stale entries on pop, against decreasing
+ * each queued vertex's key in place through an indexed heap. */
+static void sptl_bench_dijkstra(void) {
+    const uint32_t vertices = 1u << 17, degree = 16;
+    Sp_Dynamic_Array(uint32_t) targets = {0};
+    Sp_Dynamic_Array(uint32_t) weights = {0};
+    uint64_t x = 0x9E3779B97F4A7C15u;
+    for (size_t i = 0; i < (size_t) vertices * degree; ++i) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        sp_da_push(&targets, (uint32_t) (x % vertices));
+        sp_da_push(&weights, (uint32_t) (x >> 44));
+    }
+    Sp_Dynamic_Array(uint64_t) dist = {0};
+    Sp_Dynamic_Array(Sp_Heap_Handle) handle_of = {0};
+    sp_da_reserve(&dist, vertices);
+    sp_da_reserve(&handle_of, vertices);
+    uint64_t lazy_sum = 0, indexed_sum = 0;
+    size_t lazy_peak = 0, indexed_peak = 0;
+
+    memset(dist.data, 0xFF, vertices * sizeof(*dist.data));
+    Sp_Heap(sptl_bench_hop) lazy = {0};
+    double start = sptl_bench_now();
+    dist.data[0] = 0;
+    sp_heap_push_by(&lazy, ((sptl_bench_hop) {0}), sptl_bench_hop_closer);
+    while (lazy.count > 0) {
+        const sptl_bench_hop hop = sp_heap_top(&lazy);
+        sp_heap_pop_by(&lazy, sptl_bench_hop_closer);
+        if (hop.dist > dist.data[hop.vertex]) {
+            continue;
+        }
+        lazy_sum += hop.dist;
+        for (size_t e = (size_t) hop.vertex * degree; e < (size_t) (hop.vertex + 1) * degree; ++e) {
+            const uint64_t d = hop.dist + weights.data[e];
+            if (d < dist.data[targets.data[e]]) {
+                dist.data[targets.data[e]] = d;
+                sp_heap_push_by(&lazy, ((sptl_bench_hop) {d, targets.data[e]}), sptl_bench_hop_closer);
+                lazy_peak = lazy.count > lazy_peak ? lazy.count : lazy_peak;
+            }
+        }
+    }
+    const double lazy_time = sptl_bench_now() - start;
+    sp_heap_free(&lazy);
+
+    memset(dist.data, 0xFF, vertices * sizeof(*dist.data));
+    Sp_Indexed_Heap(sptl_bench_hop) indexed = {0};
+    start = sptl_bench_now();
+    dist.data[0] = 0;
+    sp_iheap_push_by(&indexed, ((sptl_bench_hop) {0}), &handle_of.data[0], sptl_bench_hop_closer);
+    while (indexed.count > 0) {
+        const sptl_bench_hop hop = sp_iheap_top(&indexed);
+        sp_iheap_pop_by(&indexed, sptl_bench_hop_closer);
+        indexed_sum += hop.dist;
+        for (size_t e = (size_t) hop.vertex * degree; e < (size_t) (hop.vertex + 1) * degree; ++e) {
+            const uint64_t d = hop.dist + weights.data[e];
+            const uint32_t to = targets.data[e];
+            if (dist.data[to] == UINT64_MAX) {
+                dist.data[to] = d;
+                sp_iheap_push_by(&indexed, ((sptl_bench_hop) {d, to}), &handle_of.data[to], sptl_bench_hop_closer);
+                indexed_peak = indexed.count > indexed_peak ? indexed.count : indexed_peak;
+            } else if (d < dist.data[to]) {
+                dist.data[to] = d;
+                sp_iheap_decrease_key_by(&indexed, handle_of.data[to], ((sptl_bench_hop) {d, to}),
+                                         sptl_bench_hop_closer);
+            }
+        }
+    }
+    const double indexed_time = sptl_bench_now() - start;
+    sp_iheap_free(&indexed);
+
+    assert(lazy_sum == indexed_sum);
+    sptl_bench_sink = indexed_sum;
+    sp_log(SP_INFO,
+           "Dijkstra 128K vertices, 2M edges: lazy Sp_Heap %.1f ms (peak %zu entries), Sp_Indexed_Heap "
+           "decrease-key %.1f ms (peak %zu entries)",
+           lazy_time * 1e3, lazy_peak, indexed_time * 1e3, indexed_peak);
+
+    sp_da_free(&targets);
+    sp_da_free(&weights);
+    sp_da_free(&dist);
+    sp_da_free(&handle_of);
+}
+
+int main(void) {
+    const size_t key_lens[] = {4, 8, 16, 32, 64, 256, 4096};
+    for (size_t i = 0; i < sizeof(key_lens) / sizeof(*key_lens); ++i) {
+        sptl_bench_hash(key_lens[i]);
+    }
+
+    sptl_bench_queue();
+    sptl_bench_ring(SPTL_BENCH_MUTEX, "mutex + Sp_Queue", 1, 1);
+    sptl_bench_ring(SPTL_BENCH_SPSC, "Sp_Spsc_Ring", 1, 1);
+    sptl_bench_ring(SPTL_BENCH_SPSC, "Sp_Spsc_Ring", 1, 32);
+    sptl_bench_ring(SPTL_BENCH_MUTEX, "mutex + Sp_Queue", 4, 1);
+    sptl_bench_ring(SPTL_BENCH_MPMC, "Sp_Mpmc_Ring", 4, 1);
+    sptl_bench_ring(SPTL_BENCH_MUTEX, "mutex + Sp_Queue", 4, 32);
+    sptl_bench_ring(SPTL_BENCH_MPMC, "Sp_Mpmc_Ring", 4, 32);
+    sptl_bench_ht(1000);
+    sptl_bench_ht(1000000);
+    sptl_bench_ht_literal_keys();
+    sptl_bench_list_traversal(1000000);
+    sptl_bench_format();
+    sptl_bench_sv();
+    sptl_bench_bitset();
+    sptl_bench_bloom(0.1);
+    sptl_bench_bloom(0.01);
+    sptl_bench_bloom(0.001);
+    sptl_bench_bloom(1e-4);
+    sptl_bench_bloom(1e-5);
+    sptl_bench_bloom(1e-6);
+    sptl_bench_roaring();
+    sptl_bench_heap();
+    sptl_bench_heap_timers();
+    sptl_bench_dijkstra();
+
+    return 0;
+}
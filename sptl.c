@@ -1,6 +1,27 @@
+#define _POSIX_C_SOURCE 200809L // posix_madvise() for the Sp_File_Map hints
 #include "sptl.h"
 #include <cmocka.h>
 #include <string.h>
+#include <threads.h>
+
+typedef struct {
+    size_t live_bytes;
+    size_t allocs;
+} sptl_test_allocator__stats;
+
+static void *sptl_test_allocator__alloc(void *ctx, size_t bytes) {
+    sptl_test_allocator__stats *stats = ctx;
+    stats->live_bytes += bytes;
+    ++stats->allocs;
+    return malloc(bytes);
+}
+
+static void sptl_test_allocator__free(void *ctx, void *ptr, size_t bytes) {
+    sptl_test_allocator__stats *stats = ctx;
+    assert_true(stats->live_bytes >= bytes);
+    stats->live_bytes -= bytes;
+    free(ptr);
+}
 
 static void sptl_test_da_resize(void **state) {
     (void) state;
@@ -66,6 +87,188 @@ static void sptl_test_da_pop_shrink(void **state) {
     sp_da_free(&da);
 }
 
+static void sptl_test_da_shrink_hysteresis(void **state) {
+    (void) state;
+
+    Sp_Dynamic_Array(int) da = {0};
+
+    for (size_t i = 0; i < 4; ++i) {
+        sp_da_push(&da, (int) i);
+    }
+    sp_da_pop(&da);
+    assert_true(da.capacity == 8);
+
+    // Alternating around the threshold that just shrank the array must not resize it again.
+    for (size_t i = 0; i < 10; ++i) {
+        sp_da_push(&da, 1);
+        assert_true(da.capacity == 8);
+        sp_da_pop(&da);
+        assert_true(da.capacity == 8);
+    }
+
+    for (size_t i = 0; i < 100; ++i) {
+        sp_da_pop(&da);
+    }
+    assert_true(da.count == 0);
+    assert_true(da.capacity > 0); // never shrinks down to an empty allocation on its own
+
+    sp_da_free(&da);
+}
+
+static void sptl_test_da_shrink_to_fit(void **state) {
+    (void) state;
+
+    Sp_Dynamic_Array(int) da = {0};
+
+    for (int i = 0; i < 100; ++i) {
+        sp_da_push(&da, i);
+    }
+    assert_true(da.capacity == 128);
+
+    sp_da_shrink_to_fit(&da);
+    assert_true(da.capacity == 100);
+    for (int i = 0; i < 100; ++i) {
+        assert_true(da.data[i] == i);
+    }
+
+    da.count = 0;
+    sp_da_shrink_to_fit(&da);
+    assert_true(da.data == NULL);
+    assert_true(da.capacity == 0);
+
+    Sp_String_Builder sb = {0};
+    sp_sb_appendf(&sb, "hello");
+    sp_sb_shrink_to_fit(&sb);
+    assert_true(sb.capacity == 6);
+    assert_true(strcmp(sb.data, "hello") == 0);
+
+    sp_da_free(&sb);
+}
+
+static void sptl_test_sb_append(void **state) {
+    (void) state;
+
+    Sp_String_Builder sb = {0};
+
+    sp_sb_append_cstr(&sb, "x=");
+    sp_sb_append_int(&sb, -42);
+    sp_sb_append_char(&sb, ',');
+    sp_sb_append_uint(&sb, UINT64_MAX);
+    sp_sb_append_char(&sb, ',');
+    sp_sb_append_int(&sb, INT64_MIN);
+    sp_sb_append_char(&sb, ',');
+    sp_sb_append_uint(&sb, 0);
+    sp_sb_append_char(&sb, ',');
+    sp_sb_append_double(&sb, 0.1);
+    sp_sb_append_sv(&sb, sp_cstr_slice(";"));
+    assert_true(strcmp(sb.data, "x=-42,18446744073709551615,-9223372036854775808,0,0.1;") == 0);
+    assert_true(sb.count == strlen(sb.data));
+
+    // Appending the builder onto itself while it has to grow
+    sp_da_shrink_to_fit(&sb);
+    sp_sb_append_sv(&sb, (Sp_String_View) {.ptr = sb.data, .count = 2});
+    assert_true(strcmp(sb.data + sb.count - 3, ";x=") == 0);
+
+    sp_sb_shrink_to_fit(&sb);
+    assert_true(sb.data != NULL);
+    const size_t count = sb.count;
+    sp_sb_appendf(&sb, "|" SP_SV_FMT, sp_sv_arg(((Sp_String_View) {.ptr = sb.data, .count = count})));
+    assert_true(sb.count == 2 * count + 1);
+    assert_true(memcmp(sb.data, sb.data + count + 1, count) == 0);
+    assert_true(sb.data[count] == '|');
+
+    // Fits in spare capacity: formatted in one pass
+    sp_da_reserve(&sb, sb.count + 64);
+    char *data = sb.data;
+    sp_sb_appendf(&sb, "%d-%s", 7, "fast");
+    assert_true(sb.data == data);
+    assert_true(strcmp(sb.data + sb.count - 6, "7-fast") == 0);
+
+    sp_da_free(&sb);
+}
+
+static void sptl_test_sb_append_numbers(void **state) {
+    (void) state;
+
+    Sp_String_Builder sb = {0};
+    char expected[64];
+
+    const uint64_t uints[] = {0, 1, 9, 10, 99, 100, 999, 1000, 4294967295u, 10000000000000000000u, UINT64_MAX};
+    for (size_t i = 0; i < sizeof(uints) / sizeof(*uints); ++i) {
+        sb.count = 0;
+        sp_sb_append_uint(&sb, uints[i]);
+        snprintf(expected, sizeof(expected), "%llu", (unsigned long long) uints[i]);
+        assert_true(strcmp(sb.data, expected) == 0);
+
+        sb.count = 0;
+        sp_sb_append_hex(&sb, uints[i]);
+        snprintf(expected, sizeof(expected), "%llx", (unsigned long long) uints[i]);
+        assert_true(strcmp(sb.data, expected) == 0);
+    }
+
+    const int64_t ints[] = {0, -1, 7, -10, 123456789, -987654321012, INT64_MAX, INT64_MIN};
+    for (size_t i = 0; i < sizeof(ints) / sizeof(*ints); ++i) {
+        sb.count = 0;
+        sp_sb_append_int(&sb, ints[i]);
+        snprintf(expected, sizeof(expected), "%lld", (long long) ints[i]);
+        assert_true(strcmp(sb.data, expected) == 0);
+        assert_true(sb.count == strlen(expected));
+    }
+
+    sb.count = 0;
+    sp_sb_append_binary(&sb, 0);
+    sp_sb_append_char(&sb, ' ');
+    sp_sb_append_binary(&sb, UINT64_MAX);
+    assert_true(strcmp(sb.data, "0 1111111111111111111111111111111111111111111111111111111111111111") == 0);
+
+    const struct {
+        double value;
+        const char *str;
+    } doubles[] = {
+        {0.0, "0"},
+        {-0.0, "-0"},
+        {1.0, "1"},
+        {-2.5, "-2.5"},
+        {0.1, "0.1"},
+        {1.0 / 3.0, "0.3333333333333333"},
+        {123.456, "123.456"},
+        {1e21, "1e+21"},
+        {1e20, "100000000000000000000"},
+        {1.5e-7, "1.5e-7"},
+        {0.000001, "0.000001"},
+        {5e-324, "5e-324"},
+        {1.7976931348623157e308, "1.7976931348623157e+308"},
+        {2.2250738585072014e-308, "2.2250738585072014e-308"},
+        {1.0 / 0.0, "inf"},
+        {-1.0 / 0.0, "-inf"},
+        {0.0 / 0.0, "nan"},
+    };
+    for (size_t i = 0; i < sizeof(doubles) / sizeof(*doubles); ++i) {
+        sb.count = 0;
+        sp_sb_append_double(&sb, doubles[i].value);
+        assert_true(strcmp(sb.data, doubles[i].str) == 0);
+    }
+
+    // Round trip over a spread of bit patterns
+    uint64_t x = 0x9E3779B97F4A7C15u;
+    for (int i = 0; i < 100000; ++i) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        double value;
+        memcpy(&value, &x, sizeof(value));
+        if (value != value || value - value != 0) {
+            continue;
+        }
+        sb.count = 0;
+        sp_sb_append_double(&sb, value);
+        assert_true(strtod(sb.data, NULL) == value);
+        assert_true(sb.count <= 25);
+    }
+
+    sp_da_free(&sb);
+}
+
 static void sptl_test_sb_appendf(void **state) {
     (void) state;
 
@@ -101,6 +304,148 @@ static void sptl_test_sv(void **state) {
     sp_da_free(&sb);
 }
 
+static void sptl_test_sv_find(void **state) {
+    (void) state;
+
+    // Long enough to go through the block loops, with matches at every offset around the block edges
+    char buf[200];
+    for (size_t i = 0; i < sizeof(buf); ++i) {
+        buf[i] = (char) ('a' + i % 7);
+    }
+    const Sp_String_View sv = {.ptr = buf, .count = sizeof(buf)};
+
+    for (size_t pos = 0; pos < sizeof(buf); ++pos) {
+        const char saved = buf[pos];
+        buf[pos] = '#';
+        assert_true(sp_sv_find_char(&sv, '#') == pos);
+
+        if (pos + 3 <= sizeof(buf)) {
+            buf[pos + 1] = '$';
+            buf[pos + 2] = '#';
+            const Sp_String_View needle = sp_cstr_slice("#$#");
+            assert_true(sp_sv_find(&sv, &needle) == pos);
+            buf[pos + 1] = (char) ('a' + (pos + 1) % 7);
+            buf[pos + 2] = (char) ('a' + (pos + 2) % 7);
+        }
+        buf[pos] = saved;
+    }
+    assert_true(sp_sv_find_char(&sv, '#') == SP_SV_NPOS);
+
+    // First/last bytes match often, middle rarely
+    Sp_String_View needle = sp_cstr_slice("abcdefgab");
+    assert_true(sp_sv_find(&sv, &needle) == 0);
+    needle = sp_cstr_slice("abXdefgab");
+    assert_true(sp_sv_find(&sv, &needle) == SP_SV_NPOS);
+    needle = sp_cstr_slice("");
+    assert_true(sp_sv_find(&sv, &needle) == 0);
+    needle = sp_cstr_slice("g");
+    assert_true(sp_sv_find(&sv, &needle) == 6);
+
+    const Sp_String_View tail = sp_sv_slice(&sv, 190, 1000);
+    assert_true(tail.count == 10);
+    needle = sp_cstr_slice("abcdefgabcdefg");
+    assert_true(sp_sv_find(&tail, &needle) == SP_SV_NPOS);
+
+    Sp_String_View prefix = sp_cstr_slice("abc");
+    assert_true(sp_sv_starts_with(&sv, &prefix));
+    assert_true(!sp_sv_ends_with(&sv, &prefix));
+    Sp_String_View suffix = sp_cstr_slice("fgabcd"); // buf[199] is 'a' + 199 % 7
+    assert_true(sp_sv_ends_with(&sv, &suffix));
+    assert_true(!sp_sv_starts_with(&prefix, &suffix));
+}
+
+static void sptl_test_sv_split_trim(void **state) {
+    (void) state;
+
+    const char *expected[] = {"a", "", " b c ", ""};
+    Sp_String_View rest = sp_cstr_slice("a,, b c ,");
+    Sp_String_View field;
+    size_t fields = 0;
+    while (sp_sv_split_next(&rest, ',', &field)) {
+        Sp_String_View want = sp_cstr_slice(expected[fields]);
+        assert_true(sp_sv_eq(&field, &want));
+        ++fields;
+    }
+    assert_true(fields == 4);
+
+    Sp_String_View trimmed = sp_sv_trim(sp_cstr_slice(" \t\r\n b c \n"));
+    Sp_String_View want = sp_cstr_slice("b c");
+    assert_true(sp_sv_eq(&trimmed, &want));
+    trimmed = sp_sv_trim(sp_cstr_slice(" \t "));
+    assert_true(trimmed.count == 0);
+
+    rest = (Sp_String_View) {0};
+    assert_true(!sp_sv_split_next(&rest, ',', &field));
+}
+
+static void sptl_test_sv_lines(void **state) {
+    (void) state;
+
+    const char *expected[] = {"first", "", "third", "last"};
+    Sp_String_View rest = sp_cstr_slice("first\n\r\nthird\r\nlast");
+    Sp_String_View line;
+    size_t lines = 0;
+    while (sp_sv_next_line(&rest, &line)) {
+        Sp_String_View want = sp_cstr_slice(expected[lines]);
+        assert_true(sp_sv_eq(&line, &want));
+        ++lines;
+    }
+    assert_true(lines == 4);
+
+    rest = sp_cstr_slice("only\n");
+    assert_true(sp_sv_next_line(&rest, &line) && line.count == 4);
+    assert_true(!sp_sv_next_line(&rest, &line));
+}
+
+static void sptl_test_file_map(void **state) {
+    (void) state;
+
+    const char *path = "sptl_test_file_map.txt";
+    FILE *file = fopen(path, "wb");
+    assert_true(file != NULL);
+
+    // Lines longer than a chunk and a final line without a newline
+    Sp_String_Builder contents = {0};
+    for (int i = 0; i < 2000; ++i) {
+        sp_sb_append_int(&contents, i);
+        sp_sb_append_char(&contents, ':');
+        for (int j = 0; j < (i % 97) * (i % 13 == 0 ? 1000 : 1); ++j) {
+            sp_sb_append_char(&contents, (char) ('a' + j % 26));
+        }
+        if (i != 1999) sp_sb_append_cstr(&contents, i % 2 ? "\r\n" : "\n");
+    }
+    assert_true(fwrite(contents.data, 1, contents.count, file) == contents.count);
+    fclose(file);
+
+    Sp_File_Map map = {0};
+    assert_true(sp_file_map_open(&map, path, SP_FILE_MAP_SEQUENTIAL | SP_FILE_MAP_WILLNEED) == 0);
+    assert_true(map.view.count == contents.count);
+    assert_true(memcmp(map.view.ptr, contents.data, contents.count) == 0);
+
+    // The streaming reader sees the same lines as the view
+    Sp_File_Reader reader = {.file = fopen(path, "rb")};
+    assert_true(reader.file != NULL);
+    Sp_String_View rest = map.view, line, streamed;
+    size_t lines = 0;
+    while (sp_sv_next_line(&rest, &line)) {
+        assert_true(sp_file_reader_next_line(&reader, &streamed));
+        assert_true(sp_sv_eq(&line, &streamed));
+        assert_true(line.count == 0 || line.ptr[line.count - 1] != '\r');
+        ++lines;
+    }
+    assert_true(!sp_file_reader_next_line(&reader, &streamed));
+    assert_true(lines == 2000);
+    fclose(reader.file);
+    sp_file_reader_free(&reader);
+    sp_file_map_close(&map);
+
+    assert_true(sp_file_map_open(&map, "sptl_test_file_map.missing", 0) == -1);
+    assert_true(errno == ENOENT);
+
+    remove(path);
+    sp_da_free(&contents);
+}
+
 static void sptl_test_ll_push_pop_back(void **state) {
     (void) state;
 
@@ -158,6 +503,135 @@ static void sptl_test_ll_push_pop_front(void **state) {
     assert_true(ll.head == NULL);
     assert_true(ll.tail == NULL);
 }
+static void sptl_test_ll_pool(void **state) {
+    (void) state;
+
+    sptl_test_allocator__stats stats = {0};
+    const Sp_Allocator allocator = {
+        .alloc = sptl_test_allocator__alloc,
+        .free = sptl_test_allocator__free,
+        .ctx = &stats,
+    };
+
+    // Queue-like use recycles popped nodes instead of allocating
+    Sp_Linked_List(int) ll = {.allocator = &allocator};
+    sp_ll_push_back(&ll, 0);
+    sp_ll_node *recycled = ll.head;
+    sp_ll_pop_front(&ll);
+    for (int i = 0; i < 10000; ++i) {
+        sp_ll_push_back(&ll, i);
+        assert_true(ll.tail == recycled);
+        assert_true(*sp_ll_node_unwrap(&ll, ll.head) == i);
+        sp_ll_pop_front(&ll);
+    }
+    assert_true(stats.allocs == 1);
+
+    // Slabs grow geometrically
+    for (int i = 0; i < 1000; ++i) {
+        sp_ll_push_front(&ll, i);
+    }
+    assert_true(stats.allocs < 10);
+    int expected = 999;
+    for (sp_ll_node *node = ll.head; node; node = node->next) {
+        assert_true(*sp_ll_node_unwrap(&ll, node) == expected--);
+    }
+    sp_ll_free(&ll);
+    assert_true(stats.live_bytes == 0);
+
+    // Shared pool: nodes released by one list are reused by another
+    Sp_Node_Pool pool = {.allocator = &allocator};
+    Sp_Linked_List(int) lhs = {.pool = &pool};
+    Sp_Linked_List(int) rhs = {.pool = &pool};
+    sp_ll_push_back(&lhs, 1);
+    sp_ll_push_back(&lhs, 2);
+    sp_ll_node *lhs_tail = lhs.tail;
+    sp_ll_free(&lhs);
+    sp_ll_push_back(&rhs, 3);
+    assert_true(rhs.head == lhs_tail);
+    sp_ll_free(&rhs);
+    sp_node_pool_free(&pool);
+    assert_true(stats.live_bytes == 0);
+}
+
+static void sptl_test_ul_push_pop(void **state) {
+    (void) state;
+
+    sptl_test_allocator__stats stats = {0};
+    const Sp_Allocator allocator = {
+        .alloc = sptl_test_allocator__alloc,
+        .free = sptl_test_allocator__free,
+        .ctx = &stats,
+    };
+
+    Sp_Unrolled_List(int) ul = {.allocator = &allocator};
+    const int n = 1000;
+    for (int i = 0; i < n; ++i) {
+        sp_ul_push_back(&ul, i);
+        sp_ul_push_front(&ul, -i - 1);
+    }
+    assert_true(ul.count == 2 * (size_t) n);
+    assert_true(sp_ul_front(&ul) == -n);
+    assert_true(sp_ul_back(&ul) == n - 1);
+    assert_true(stats.allocs <= 2 * (size_t) n / sp_ul_node_cap(&ul) + 2);
+
+    int expected = -n;
+    for (sp_ul_node *node = ul.head; node; node = node->next) {
+        for (size_t i = node->begin; i < node->end; ++i) {
+            assert_true(sp_ul_node_data(&ul, node)[i] == expected++);
+        }
+    }
+    assert_true(expected == n);
+
+    for (int i = 0; i < n; ++i) {
+        assert_true(sp_ul_back(&ul) == n - 1 - i);
+        sp_ul_pop_back(&ul);
+        assert_true(sp_ul_front(&ul) == -n + i);
+        sp_ul_pop_front(&ul);
+    }
+    assert_true(ul.count == 0);
+    assert_true(ul.head == NULL && ul.tail == NULL);
+    assert_true(stats.live_bytes == 0);
+
+    sp_ul_pop_back(&ul); // pop on empty list
+    sp_ul_pop_front(&ul);
+
+    sp_ul_free(&ul);
+}
+
+static void sptl_test_ul_splice(void **state) {
+    (void) state;
+
+    Sp_Unrolled_List(int) lhs = {0};
+    Sp_Unrolled_List(int) rhs = {0};
+
+    sp_ul_splice(&lhs, &rhs); // both empty
+    assert_true(lhs.count == 0);
+
+    for (int i = 0; i < 300; ++i) {
+        sp_ul_push_back(&rhs, i);
+    }
+    sp_ul_splice(&lhs, &rhs); // into empty
+    assert_true(lhs.count == 300 && rhs.count == 0 && rhs.head == NULL);
+
+    for (int i = 300; i < 600; ++i) {
+        sp_ul_push_back(&rhs, i);
+    }
+    sp_ul_splice(&lhs, &rhs);
+    assert_true(lhs.count == 600);
+    sp_ul_push_back(&lhs, 600);
+
+    int expected = 0;
+    for (sp_ul_node *node = lhs.head; node; node = node->next) {
+        for (size_t i = node->begin; i < node->end; ++i) {
+            assert_true(sp_ul_node_data(&lhs, node)[i] == expected++);
+        }
+    }
+    assert_true(expected == 601);
+
+    sp_ul_free(&lhs);
+    sp_ul_free(&rhs);
+}
+
 static void sptl_test_queue_pop_overflow(void **state) {
     (void) state;
 
@@ -215,6 +689,205 @@ static void sptl_test_queue_push_peek_pop(void **state) {
     assert_true(queue.capacity == 0);
 }
 
+static void sptl_test_queue_bulk(void **state) {
+    (void) state;
+
+    sptl_test_allocator__stats stats = {0};
+    const Sp_Allocator allocator = {
+        .alloc = sptl_test_allocator__alloc,
+        .free = sptl_test_allocator__free,
+        .ctx = &stats,
+    };
+    Sp_Queue(int) queue = {.allocator = &allocator};
+
+    int items[100];
+    for (int i = 0; i < 100; ++i) {
+        items[i] = i;
+    }
+
+    // Wrap the contents around the end of the slot array, then grow: order must survive
+    sp_queue_push_n(&queue, items, 12);
+    int out[100];
+    size_t popped;
+    sp_queue_pop_n(&queue, out, 10, &popped);
+    assert_true(popped == 10 && out[0] == 0 && out[9] == 9);
+    sp_queue_push_n(&queue, items + 12, 14);
+    assert_true(queue.count == 16 && queue.capacity == SP_QUEUE_INIT_CAP);
+
+    Sp_Queue_Spans(int) spans;
+    sp_queue_read_spans(&queue, &spans);
+    assert_true(spans.count[0] == 6 && spans.count[1] == 10);
+    assert_true(spans.data[0][0] == 10 && spans.data[1][0] == 16);
+
+    sp_queue_push_n(&queue, items + 26, 74);
+    assert_true(queue.count == 90);
+    sp_queue_read_spans(&queue, &spans);
+    assert_true(spans.count[0] == 90 && spans.count[1] == 0);
+
+    sp_queue_pop_n(&queue, out, 100, &popped);
+    assert_true(popped == 90 && queue.count == 0);
+    for (size_t i = 0; i < popped; ++i) {
+        assert_true(out[i] == (int) i + 10);
+    }
+
+    // Zero-copy producer and consumer
+    sp_queue_write_spans(&queue, 5, &spans);
+    int next = 0;
+    for (size_t s = 0; s < 2; ++s) {
+        for (size_t i = 0; i < spans.count[s]; ++i) {
+            spans.data[s][i] = next++;
+        }
+    }
+    sp_queue_commit(&queue, 3); // only the first 3 are published
+    assert_true(queue.count == 3 && sp_queue_peek(&queue) == 0);
+    sp_queue_consume(&queue, 2);
+    assert_true(sp_queue_peek(&queue) == 2);
+    sp_queue_pop_n(&queue, out, 0, &popped);
+    assert_true(popped == 0 && queue.count == 1);
+
+    sp_queue_free(&queue);
+    assert_true(stats.live_bytes == 0);
+}
+
+#define SPTL_TEST_RING_ITEMS 200000
+
+static Sp_Spsc_Ring(uint32_t) sptl_test_spsc;
+
+static int sptl_test_spsc_producer(void *arg) {
+    (void) arg;
+    uint32_t batch[7];
+    for (uint32_t next = 0; next < SPTL_TEST_RING_ITEMS;) {
+        size_t n = 0;
+        for (; n < 7 && next + n < SPTL_TEST_RING_ITEMS; ++n) {
+            batch[n] = next + (uint32_t) n;
+        }
+        size_t pushed;
+        sp_spsc_ring_push_n(&sptl_test_spsc, batch, n, &pushed);
+        next += (uint32_t) pushed;
+        if (!pushed) thrd_yield();
+    }
+    return 0;
+}
+
+static void sptl_test_spsc_ring(void **state) {
+    (void) state;
+
+    sp_spsc_ring_init(&sptl_test_spsc, 5);
+    assert_true(sptl_test_spsc.cursors.capacity == 8);
+
+    // Full and empty rings refuse instead of blocking; batches stop at the boundary
+    const uint32_t items[10] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+    uint32_t out[10];
+    size_t moved;
+    sp_spsc_ring_push_n(&sptl_test_spsc, items, 6, &moved);
+    assert_true(moved == 6);
+    sp_spsc_ring_pop_n(&sptl_test_spsc, out, 4, &moved);
+    assert_true(moved == 4 && out[0] == 0 && out[3] == 3);
+    sp_spsc_ring_push_n(&sptl_test_spsc, items + 6, 4, &moved); // wraps around
+    assert_true(moved == 4);
+    sp_spsc_ring_push(&sptl_test_spsc, 10, &moved);
+    sp_spsc_ring_push(&sptl_test_spsc, 11, &moved);
+    sp_spsc_ring_push(&sptl_test_spsc, 12, &moved);
+    assert_true(moved == 0);
+    sp_spsc_ring_pop_n(&sptl_test_spsc, out, 10, &moved);
+    assert_true(moved == 8);
+    for (size_t i = 0; i < moved; ++i) {
+        assert_true(out[i] == 4 + i);
+    }
+    sp_spsc_ring_pop(&sptl_test_spsc, out, &moved);
+    assert_true(moved == 0);
+    sp_spsc_ring_free(&sptl_test_spsc);
+
+    // Across threads every element arrives once and in order
+    sp_spsc_ring_init(&sptl_test_spsc, 64);
+    thrd_t producer;
+    assert_true(thrd_create(&producer, sptl_test_spsc_producer, NULL) == thrd_success);
+    uint32_t expected = 0;
+    while (expected < SPTL_TEST_RING_ITEMS) {
+        sp_spsc_ring_pop_n(&sptl_test_spsc, out, 10, &moved);
+        for (size_t i = 0; i < moved; ++i) {
+            assert_true(out[i] == expected++);
+        }
+        if (!moved) thrd_yield();
+    }
+    thrd_join(producer, NULL);
+    sp_spsc_ring_free(&sptl_test_spsc);
+    assert_true(sptl_test_spsc.data == NULL);
+}
+
+static Sp_Mpmc_Ring(uint32_t) sptl_test_mpmc;
+static atomic_size_t sptl_test_mpmc_popped;
+static atomic_uint_least64_t sptl_test_mpmc_sum;
+
+static int sptl_test_mpmc_producer(void *arg) {
+    const uint32_t base = (uint32_t) (uintptr_t) arg * SPTL_TEST_RING_ITEMS;
+    for (uint32_t i = 0; i < SPTL_TEST_RING_ITEMS;) {
+        const uint32_t batch[3] = {base + i, base + i + 1, base + i + 2};
+        size_t pushed;
+        sp_mpmc_ring_push_n(&sptl_test_mpmc, batch, i + 3 <= SPTL_TEST_RING_ITEMS ? 3 : SPTL_TEST_RING_ITEMS - i,
+                            &pushed);
+        i += (uint32_t) pushed;
+        if (!pushed) thrd_yield();
+    }
+    return 0;
+}
+
+static int sptl_test_mpmc_consumer(void *arg) {
+    (void) arg;
+    uint32_t out[5];
+    while (atomic_load(&sptl_test_mpmc_popped) < 2 * SPTL_TEST_RING_ITEMS) {
+        size_t popped;
+        sp_mpmc_ring_pop_n(&sptl_test_mpmc, out, 5, &popped);
+        uint64_t sum = 0;
+        for (size_t i = 0; i < popped; ++i) {
+            sum += out[i];
+        }
+        atomic_fetch_add(&sptl_test_mpmc_sum, sum);
+        atomic_fetch_add(&sptl_test_mpmc_popped, popped);
+        if (!popped) thrd_yield();
+    }
+    return 0;
+}
+
+static void sptl_test_mpmc_ring(void **state) {
+    (void) state;
+
+    sp_mpmc_ring_init(&sptl_test_mpmc, 3);
+    assert_true(sptl_test_mpmc.cursors.capacity == 4);
+
+    const uint32_t items[6] = {0, 1, 2, 3, 4, 5};
+    uint32_t out[6];
+    size_t moved;
+    sp_mpmc_ring_push_n(&sptl_test_mpmc, items, 6, &moved);
+    assert_true(moved == 4);
+    sp_mpmc_ring_push(&sptl_test_mpmc, 9, &moved);
+    assert_true(moved == 0);
+    sp_mpmc_ring_pop_n(&sptl_test_mpmc, out, 3, &moved);
+    assert_true(moved == 3 && out[0] == 0 && out[2] == 2);
+    sp_mpmc_ring_push_n(&sptl_test_mpmc, items + 4, 2, &moved); // wraps around
+    assert_true(moved == 2);
+    sp_mpmc_ring_pop_n(&sptl_test_mpmc, out, 6, &moved);
+    assert_true(moved == 3 && out[0] == 3 && out[1] == 4 && out[2] == 5);
+    sp_mpmc_ring_pop(&sptl_test_mpmc, out, &moved);
+    assert_true(moved == 0);
+    sp_mpmc_ring_free(&sptl_test_mpmc);
+
+    // Two producers and two consumers: every element is popped exactly once
+    sp_mpmc_ring_init(&sptl_test_mpmc, 16);
+    thrd_t threads[4];
+    for (uintptr_t i = 0; i < 2; ++i) {
+        assert_true(thrd_create(&threads[i], sptl_test_mpmc_producer, (void *) i) == thrd_success);
+        assert_true(thrd_create(&threads[2 + i], sptl_test_mpmc_consumer, NULL) == thrd_success);
+    }
+    for (size_t i = 0; i < 4; ++i) {
+        thrd_join(threads[i], NULL);
+    }
+    const uint64_t total = 2 * (uint64_t) SPTL_TEST_RING_ITEMS;
+    assert_true(atomic_load(&sptl_test_mpmc_popped) == total);
+    assert_true(atomic_load(&sptl_test_mpmc_sum) == total * (total - 1) / 2);
+    sp_mpmc_ring_free(&sptl_test_mpmc);
+}
+
 static void sptl_test_ht_insert(void **state) {
     (void) state;
 
@@ -251,6 +924,51 @@ static void sptl_test_ht_insert(void **state) {
     assert_true(ht.count == 0);
 }
 
+static void sptl_test_ht_mut_str_keys(void **state) {
+    (void) state;
+
+    // `char *` keys compare by characters, not by address
+    char first[] = "Alpha", second[] = "Alpha";
+    char *a = first, *b = second;
+    Sp_Hash_Table(char *, int) ht = {0};
+    sp_ht_insert(&ht, a, 1);
+    sp_ht_insert(&ht, b, 2);
+    assert_true(ht.count == 1);
+
+    sp_ht_node_t(&ht) *ptr = NULL;
+    sp_ht_get(&ht, a, &ptr);
+    assert_true(ptr != NULL && ptr->value == 2);
+    sp_ht_free(&ht);
+}
+
+static void sptl_test_ht_float_keys(void **state) {
+    (void) state;
+
+    // Floating-point keys compare by value: -0.0 finds 0.0, and NaN never equals itself
+    Sp_Hash_Table(double, int) ht = {0};
+    sp_ht_insert(&ht, 0.0, 1);
+    sp_ht_insert(&ht, -0.0, 2);
+    sp_ht_insert(&ht, 1.5, 3);
+    assert_true(ht.count == 2);
+
+    sp_ht_node_t(&ht) *ptr = NULL;
+    sp_ht_get(&ht, -0.0, &ptr);
+    assert_true(ptr != NULL && ptr->value == 2);
+
+    const double nan = 0.0 / 0.0;
+    sp_ht_insert(&ht, nan, 4);
+    sp_ht_get(&ht, nan, &ptr);
+    assert_true(ptr == NULL);
+    sp_ht_free(&ht);
+
+    Sp_Hash_Table(float, int) floats = {0};
+    sp_ht_insert(&floats, 0.25f, 1);
+    sp_ht_node_t(&floats) *fptr = NULL;
+    sp_ht_get(&floats, 0.25f, &fptr);
+    assert_true(fptr != NULL && fptr->value == 1);
+    sp_ht_free(&floats);
+}
+
 static void sptl_test_ht_dup_insert(void **state) {
     (void) state;
 
@@ -299,6 +1017,411 @@ static void sptl_test_ht_sv_insert(void **state) {
     sp_ht_free(&ht);
 }
 
+static void sptl_test_ht_grow(void **state) {
+    (void) state;
+
+    Sp_String_Builder keys = {0};
+    sp_da_reserve(&keys, 8192); // views below point into keys, so it must not move
+
+    Sp_Hash_Table(Sp_String_View, int) ht = {0};
+    sp_ht_node_t(&ht) *ptr = NULL;
+
+    for (int i = 0; i < 1000; ++i) {
+        const size_t start = keys.count;
+        sp_sb_appendf(&keys, "key%d", i);
+        Sp_String_View sv = {.ptr = keys.data + start, .count = keys.count - start};
+        sp_ht_insert(&ht, sv, i);
+    }
+
+    assert_true(ht.count == 1000);
+    assert_true((ht.table.capacity & (ht.table.capacity - 1)) == 0);
+    assert_true(ht.count <= sp_ht_max_load(ht.table.capacity));
+
+    char buf[16];
+    for (int i = 0; i < 1000; ++i) {
+        Sp_String_View sv = {.ptr = buf, .count = (size_t) snprintf(buf, sizeof(buf), "key%d", i)};
+        sp_ht_get(&ht, sv, &ptr);
+        assert_true(ptr != NULL);
+        assert_true(ptr->value == i);
+    }
+
+    sp_ht_get(&ht, sp_cstr_slice("key1000"), &ptr);
+    assert_true(ptr == NULL);
+
+    size_t full = 0;
+    for (size_t i = 0; i < ht.table.capacity; ++i) {
+        full += sp_ht_slot_full(&ht, i);
+    }
+    assert_true(full == ht.count);
+
+    sp_ht_free(&ht);
+    sp_da_free(&keys);
+}
+
+static void sptl_test_ht_remove(void **state) {
+    (void) state;
+
+    Sp_Hash_Table(const char *, int) ht = {0};
+    int *value = NULL;
+
+    sp_ht_insert(&ht, sp_cstr("Alpha"), 1);
+    sp_ht_insert(&ht, sp_cstr("Beta"), 2);
+
+    sp_ht_remove(&ht, sp_cstr("Alpha"));
+    sp_ht_remove(&ht, sp_cstr("Gamma")); // absent keys are ignored
+    assert_true(ht.count == 1);
+
+    sp_ht_find(&ht, sp_cstr("Alpha"), &value);
+    assert_true(value == NULL);
+    sp_ht_find(&ht, sp_cstr("Beta"), &value);
+    assert_true(value != NULL);
+    assert_true(*value == 2);
+
+    sp_ht_insert(&ht, sp_cstr("Alpha"), 3);
+    sp_ht_find(&ht, sp_cstr("Alpha"), &value);
+    assert_true(*value == 3);
+
+    sp_ht_free(&ht);
+}
+
+static void sptl_test_ht_churn(void **state) {
+    (void) state;
+
+    Sp_String_Builder keys = {0};
+    sp_da_reserve(&keys, 65536);
+
+    Sp_Hash_Table(Sp_String_View, int) ht = {0};
+    sp_ht_node_t(&ht) *ptr = NULL;
+
+    // Sliding window of 100 live keys: tombstones must be compacted instead of growing the table.
+    for (int i = 0; i < 5000; ++i) {
+        const size_t start = keys.count;
+        sp_sb_appendf(&keys, "k%d", i);
+        Sp_String_View sv = {.ptr = keys.data + start, .count = keys.count - start};
+        sp_ht_insert(&ht, sv, i);
+        if (i >= 100) {
+            char buf[16];
+            Sp_String_View old = {.ptr = buf, .count = (size_t) snprintf(buf, sizeof(buf), "k%d", i - 100)};
+            sp_ht_remove(&ht, old);
+        }
+        assert_true(ht.count + ht.tombstones <= sp_ht_max_load(ht.table.capacity));
+    }
+
+    assert_true(ht.count == 100);
+    assert_true(ht.table.capacity <= 512);
+
+    for (int i = 4900; i < 5000; ++i) {
+        char buf[16];
+        Sp_String_View sv = {.ptr = buf, .count = (size_t) snprintf(buf, sizeof(buf), "k%d", i)};
+        sp_ht_get(&ht, sv, &ptr);
+        assert_true(ptr != NULL);
+        assert_true(ptr->value == i);
+    }
+
+    sp_ht_free(&ht);
+    sp_da_free(&keys);
+}
+
+static void sptl_test_ht_get_or_insert(void **state) {
+    (void) state;
+
+    const char *words[] = {"a", "b", "a", "c", "a", "b"};
+    Sp_Hash_Table(const char *, int) ht = {0};
+    sp_ht_node_t(&ht) *ptr = NULL;
+
+    for (size_t i = 0; i < sizeof(words) / sizeof(*words); ++i) {
+        sp_ht_get_or_insert(&ht, words[i], &ptr);
+        ++ptr->value;
+    }
+
+    assert_true(ht.count == 3);
+    sp_ht_get(&ht, sp_cstr("a"), &ptr);
+    assert_true(ptr->value == 3);
+    sp_ht_get(&ht, sp_cstr("b"), &ptr);
+    assert_true(ptr->value == 2);
+    sp_ht_get(&ht, sp_cstr("c"), &ptr);
+    assert_true(ptr->value == 1);
+
+    sp_ht_free(&ht);
+}
+
+static void sptl_test_ht_incremental(void **state) {
+    (void) state;
+
+    Sp_String_Builder keys = {0};
+    sp_da_reserve(&keys, 1 << 20);
+
+    Sp_Hash_Table(Sp_String_View, int) ht = {.incremental = 1};
+    sp_ht_node_t(&ht) *ptr = NULL;
+    size_t growths = 0;
+
+    for (int i = 0; i < 50000; ++i) {
+        const size_t capacity = ht.table.capacity;
+        const size_t migrated = ht.migrate_idx;
+        const int migrating = ht.old_slots != NULL;
+
+        const size_t start = keys.count;
+        sp_sb_appendf(&keys, "key%d", i);
+        Sp_String_View sv = {.ptr = keys.data + start, .count = keys.count - start};
+        sp_ht_insert(&ht, sv, i);
+
+        // Bounded work per insertion: a resize only swaps the slot arrays without moving any node,
+        // and otherwise at most SP_HT_MIGRATE_STEP old slots are walked.
+        if (capacity != 0 && ht.table.capacity != capacity) {
+            ++growths;
+            assert_true(ht.old_slots != NULL);
+            assert_true(ht.migrate_idx == 0);
+        } else if (migrating && ht.old_slots) {
+            assert_true(ht.migrate_idx - migrated <= SP_HT_MIGRATE_STEP);
+        }
+
+        // Keys must stay reachable and removable while they still sit in the old slot array.
+        if (i % 7 == 0 && i > 0) {
+            char buf[16];
+            Sp_String_View prev = {.ptr = buf, .count = (size_t) snprintf(buf, sizeof(buf), "key%d", i - 1)};
+            sp_ht_get(&ht, prev, &ptr);
+            assert_true(ptr != NULL);
+            assert_true(ptr->value == i - 1);
+            sp_ht_remove(&ht, prev);
+        }
+    }
+
+    assert_true(growths > 5);
+    sp_ht_finish_rehash(&ht);
+    assert_true(ht.old_slots == NULL);
+
+    size_t full = 0;
+    for (size_t i = 0; i < ht.table.capacity; ++i) {
+        full += sp_ht_slot_full(&ht, i);
+    }
+    assert_true(full == ht.count);
+
+    for (int i = 0; i < 50000; ++i) {
+        char buf[16];
+        Sp_String_View sv = {.ptr = buf, .count = (size_t) snprintf(buf, sizeof(buf), "key%d", i)};
+        sp_ht_get(&ht, sv, &ptr);
+        if ((i + 1) % 7 == 0 && i + 1 < 50000) {
+            assert_true(ptr == NULL);
+        } else {
+            assert_true(ptr != NULL);
+            assert_true(ptr->value == i);
+        }
+    }
+
+    sp_ht_free(&ht);
+    sp_da_free(&keys);
+}
+
+static void sptl_test_ht_int_keys(void **state) {
+    (void) state;
+
+    Sp_Hash_Table(int, int) ht = {0};
+    int *value = NULL;
+
+    for (int i = -500; i < 500; ++i) {
+        sp_ht_insert(&ht, i, i * 2);
+    }
+    assert_true(ht.count == 1000);
+    assert_true(ht.hash == NULL);
+
+    for (int i = -500; i < 500; ++i) {
+        sp_ht_find(&ht, i, &value);
+        assert_true(value != NULL);
+        assert_true(*value == i * 2);
+    }
+    sp_ht_find(&ht, 500, &value);
+    assert_true(value == NULL);
+
+    sp_ht_free(&ht);
+
+    Sp_Hash_Table(uint64_t, int) wide = {0};
+    sp_ht_insert(&wide, UINT64_MAX, 1);
+    sp_ht_insert(&wide, (uint64_t) 1 << 40, 2);
+    sp_ht_find(&wide, UINT64_MAX, &value);
+    assert_true(*value == 1);
+    sp_ht_find(&wide, (uint64_t) 1 << 40, &value);
+    assert_true(*value == 2);
+    sp_ht_free(&wide);
+}
+
+static void sptl_test_ht_pod_keys(void **state) {
+    (void) state;
+
+    typedef struct {
+        int32_t x;
+        int32_t y;
+        int32_t z;
+    } Point;
+
+    Sp_Hash_Table(Point, int) ht = {0};
+    int *value = NULL;
+
+    for (int i = 0; i < 100; ++i) {
+        sp_ht_insert(&ht, ((Point) {i, -i, i * i}), i);
+    }
+    for (int i = 0; i < 100; ++i) {
+        sp_ht_find(&ht, ((Point) {i, -i, i * i}), &value);
+        assert_true(value != NULL);
+        assert_true(*value == i);
+    }
+    sp_ht_find(&ht, ((Point) {1, 1, 1}), &value);
+    assert_true(value == NULL);
+    sp_ht_free(&ht);
+
+    int targets[4];
+    Sp_Hash_Table(void *, size_t) ptrs = {0};
+    for (size_t i = 0; i < 4; ++i) {
+        sp_ht_insert(&ptrs, (void *) &targets[i], i);
+    }
+    size_t *idx = NULL;
+    sp_ht_find(&ptrs, (void *) &targets[2], &idx);
+    assert_true(*idx == 2);
+    sp_ht_free(&ptrs);
+}
+
+static uint64_t sptl_test_ht__constant_hash(const int *key, uint64_t seed) {
+    (void) key;
+    (void) seed;
+    return 0;
+}
+
+static void sptl_test_ht_custom_hash(void **state) {
+    (void) state;
+
+    // Every key collides: the probe has to rely on key comparisons alone.
+    Sp_Hash_Table(int, int) ht = {.hash = sptl_test_ht__constant_hash};
+    int *value = NULL;
+
+    for (int i = 0; i < 100; ++i) {
+        sp_ht_insert(&ht, i, i);
+    }
+    for (int i = 0; i < 100; i += 2) {
+        sp_ht_remove(&ht, i);
+    }
+    for (int i = 0; i < 100; ++i) {
+        sp_ht_find(&ht, i, &value);
+        if (i % 2) {
+            assert_true(value != NULL);
+            assert_true(*value == i);
+        } else {
+            assert_true(value == NULL);
+        }
+    }
+
+    sp_ht_free(&ht);
+}
+
+static void sptl_test_ht_hashed_keys(void **state) {
+    (void) state;
+
+    const Sp_String_View lit = SP_SV_LIT("Bob");
+    assert_true(lit.count == 3);
+    assert_true(memcmp(lit.ptr, "Bob", 3) == 0);
+    assert_true(SP_SV_LIT("").count == 0);
+
+    const Sp_Hashed_View bob = SP_HASHED_LIT("Bob");
+    assert_true(bob.hash == sp_sv_hash(&lit, 0));
+
+    for (uint64_t seed = 0; seed < 2; ++seed) {
+        Sp_Hash_Table(Sp_Hashed_View, int) ht = {.seed = seed * 0x5eed};
+        sp_ht_insert(&ht, bob, 1);
+        sp_ht_insert(&ht, SP_HASHED_LIT("Alice"), 2);
+
+        Sp_Arena names = {0};
+        for (int i = 0; i < 100; ++i) { // growth migrates keys by their stored hash
+            char *name = sp_arena_alloc(&names, 16);
+            snprintf(name, 16, "user%d", i);
+            sp_ht_insert(&ht, sp_hashed_view(sp_cstr_slice(name)), 100 + i);
+        }
+
+        int *value;
+        sp_ht_find(&ht, bob, &value);
+        assert_true(value && *value == 1);
+        sp_ht_find(&ht, SP_HASHED_LIT("Alice"), &value);
+        assert_true(value && *value == 2);
+
+        // The stored hash is trusted: the same characters under a different hash are a different key
+        Sp_Hashed_View forged = bob;
+        forged.hash ^= 1;
+        sp_ht_find(&ht, forged, &value);
+        assert_true(value == NULL);
+
+        sp_ht_find(&ht, SP_HASHED_LIT("user42"), &value);
+        assert_true(value && *value == 142);
+
+        sp_ht_free(&ht);
+        sp_arena_free(&names);
+    }
+}
+
+static void sptl_test_intern(void **state) {
+    (void) state;
+
+    sptl_test_allocator__stats stats = {0};
+    const Sp_Allocator allocator = {
+        .alloc = sptl_test_allocator__alloc,
+        .free = sptl_test_allocator__free,
+        .ctx = &stats,
+    };
+    Sp_Intern_Pool pool = {.allocator = &allocator};
+
+    char buf[] = "apple";
+    const Sp_Intern_Id apple = sp_intern(&pool, sp_cstr_slice(buf));
+    const Sp_Intern_Id pear = sp_intern_cstr(&pool, "pear");
+    assert_true(apple == 0 && pear == 1);
+
+    buf[0] = 'A'; // the pool keeps its own copy
+    assert_true(strcmp(sp_intern_str(&pool, apple), "apple") == 0);
+    assert_true(sp_intern(&pool, SP_SV_LIT("apple")) == apple);
+    assert_true(sp_intern_find(&pool, SP_SV_LIT("Apple")) == SP_INTERN_NONE);
+    assert_true(sp_intern_view(&pool, pear).ptr == sp_intern_view(&pool, sp_intern_cstr(&pool, "pear")).ptr);
+
+    Sp_Intern_Ids ids = {0};
+    const size_t tokens = sp_intern_split(&pool, SP_SV_LIT("pear  fig apple fig "), ' ', &ids);
+    assert_true(tokens == 4);
+    assert_true(ids.data[0] == pear && ids.data[2] == apple);
+    assert_true(ids.data[1] == ids.data[3] && ids.data[1] == 2);
+
+    // Many distinct strings: IDs stay dense and canonical views stay put while the pool grows
+    const Sp_String_View fig = sp_intern_view(&pool, ids.data[1]);
+    char name[16];
+    for (int i = 0; i < 5000; ++i) {
+        snprintf(name, sizeof(name), "s%d", i);
+        assert_true(sp_intern_cstr(&pool, name) == (Sp_Intern_Id) i + 3);
+    }
+    assert_true(sp_intern_view(&pool, ids.data[1]).ptr == fig.ptr);
+    assert_true(strcmp(sp_intern_str(&pool, 4003), "s4000") == 0);
+    assert_true(sp_intern_find(&pool, SP_SV_LIT("s4999")) == 5002);
+
+    sp_da_free(&ids);
+    sp_intern_pool_free(&pool);
+    assert_true(stats.live_bytes == 0);
+}
+
+static void sptl_test_hash_bytes(void **state) {
+    (void) state;
+
+    char buf[128];
+    for (size_t i = 0; i < sizeof(buf); ++i) {
+        buf[i] = (char) ('a' + i % 26);
+    }
+
+    // Every prefix length exercises a different read path; none of them may collide.
+    uint64_t hashes[sizeof(buf)];
+    for (size_t len = 0; len < sizeof(buf); ++len) {
+        hashes[len] = sp_hash_bytes(buf, len, 0);
+        assert_true(hashes[len] == sp_hash_bytes(buf, len, 0));
+        assert_true(hashes[len] != sp_hash_bytes(buf, len, 42));
+        for (size_t j = 0; j < len; ++j) {
+            assert_true(hashes[j] != hashes[len]);
+        }
+    }
+
+    Sp_String_View sv = {.ptr = buf, .count = 5};
+    const char *cstr = "abcde";
+    assert_true(sp_sv_hash(&sv, 7) == sp_cstr_hash(&cstr, 7));
+}
+
 static void sptl_test_mh_insert(void **state) {
     (void) state;
 
@@ -355,28 +1478,405 @@ static void sptl_test_mh_expand(void **state) {
     sp_heap_free(&mh);
 }
 
-static inline Sp_String_Builder uint8_to_binary_str(uint8_t val) {
-    Sp_String_Builder sp = {0};
+static int sptl_test_heap_greater(const int a, const int b) {
+    return a > b;
+}
+
+static void sptl_test_heap_bulk(void **state) {
+    (void) state;
+
+    sptl_test_allocator__stats stats = {0};
+    const Sp_Allocator allocator = {
+        .alloc = sptl_test_allocator__alloc,
+        .free = sptl_test_allocator__free,
+        .ctx = &stats,
+    };
+
+    // Floyd construction over an existing buffer
+    Sp_Dynamic_Array(int) da = {.allocator = &allocator};
+    for (int i = 0; i < 1000; ++i) {
+        sp_da_push(&da, (i * 7919) % 1000);
+    }
+    Sp_Heap(int) heap = {0};
+    sp_heap_from_array(&heap, &da);
+    assert_true(da.data == NULL && da.count == 0);
+    assert_true(heap.count == 1000 && heap.allocator == &allocator);
+    assert_true(sp_bt_capacity_from_height(heap.height) >= 1000);
+    for (size_t i = 1; i < heap.count; ++i) {
+        assert_true(heap.data[sp_bt_node_parent_idx(i)] <= heap.data[i]);
+    }
+
+    // Small batches are sifted up, large ones rebuild the heap
+    const int few[] = {-3, 2000, -1};
+    sp_heap_push_n(&heap, few, 3);
+    assert_true(sp_heap_top(&heap) == -3);
+    int many[2000];
+    for (int i = 0; i < 2000; ++i) {
+        many[i] = 5000 - i;
+    }
+    sp_heap_push_n(&heap, many, 2000);
+    assert_true(heap.count == 3003 && sp_heap_top(&heap) == -3);
+
+    // Sorting keeps it a valid heap, top first
+    sp_heap_sort(&heap);
+    assert_true(heap.data[0] == -3 && heap.data[1] == -1 && heap.data[2] == 0);
+    for (size_t i = 1; i < heap.count; ++i) {
+        assert_true(heap.data[i - 1] <= heap.data[i]);
+    }
+    sp_heap_pop(&heap);
+    assert_true(sp_heap_top(&heap) == -1);
+    sp_heap_free(&heap);
+    assert_true(stats.live_bytes == 0);
+
+    // Top-K: a min-heap of the K largest, replacing its smallest
+    Sp_Heap(int) best = {0};
+    for (int i = 0; i < 10000; ++i) {
+        const int value = (i * 7919) % 10007;
+        if (best.count < 10) {
+            sp_heap_push(&best, value);
+        } else if (value > sp_heap_top(&best)) {
+            sp_heap_replace_top(&best, value);
+        }
+    }
+    sp_heap_sort(&best);
+    assert_true(best.data[0] == 9997 && best.data[9] == 10006);
+    sp_heap_free(&best);
+
+    // Custom order and replace_top on an empty heap
+    Sp_Heap(int) top = {.cmp = sptl_test_heap_greater};
+    sp_heap_replace_top(&top, 4);
+    sp_heap_push(&top, 9);
+    sp_heap_push(&top, 1);
+    assert_true(sp_heap_top(&top) == 9);
+    sp_heap_replace_top(&top, 0);
+    assert_true(sp_heap_top(&top) == 4);
+    sp_heap_sort(&top);
+    assert_true(top.data[0] == 4 && top.data[1] == 1 && top.data[2] == 0);
+    sp_heap_free(&top);
+}
+
+typedef struct {
+    uint64_t deadline;
+    uint32_t id;
+} sptl_test_timer;
+
+#define sptl_test_timer_earlier(a, b) ((a).deadline < (b).deadline)
+
+static int sptl_test_uint_cmp(const void *a, const void *b) {
+    const uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+static void sptl_test_heap_dary(void **state) {
+    (void) state;
+
+    Sp_Heap_D(sptl_test_timer, 4) timers = {0};
+    assert_true(sp_heap_arity(&timers) == 4);
+    assert_true(sp_heap_first_child_idx(&timers, 1) == 5 && sp_heap_parent_idx(&timers, 8) == 1);
+
+    // Interleaved pushes and pops against a sorted reference
+    uint64_t expected[3000];
+    size_t pending = 0;
+    uint64_t x = 88172645463325252ull;
+    for (uint32_t i = 0; i < 3000; ++i) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        sp_heap_push_by(&timers, ((sptl_test_timer) {.deadline = x % 100000, .id = i}), sptl_test_timer_earlier);
+        expected[pending++] = x % 100000;
+        if (i % 3 == 2) {
+            qsort(expected, pending, sizeof(*expected), sptl_test_uint_cmp);
+            assert_true(sp_heap_top(&timers).deadline == expected[0]);
+            sp_heap_pop_by(&timers, sptl_test_timer_earlier);
+            memmove(expected, expected + 1, --pending * sizeof(*expected));
+        }
+    }
+    assert_true(timers.count == pending);
+    // Every group of four 16-byte children fills exactly one cache line
+    assert_true((uintptr_t) &timers.data[sp_heap_first_child_idx(&timers, 0)] % SP_CACHE_LINE == 0);
+    for (size_t i = 1; i < timers.count; ++i) {
+        assert_true(timers.data[sp_heap_parent_idx(&timers, i)].deadline <= timers.data[i].deadline);
+    }
+
+    sp_heap_replace_top_by(&timers, ((sptl_test_timer) {.deadline = 1u << 30}), sptl_test_timer_earlier);
+    sp_heap_sort_by(&timers, sptl_test_timer_earlier);
+    qsort(expected, pending, sizeof(*expected), sptl_test_uint_cmp);
+    for (size_t i = 0; i + 1 < timers.count; ++i) {
+        assert_true(timers.data[i].deadline == expected[i + 1]);
+    }
+    assert_true(timers.data[timers.count - 1].deadline == 1u << 30);
+    sp_heap_free(&timers);
+
+    // 4-ary Floyd construction with the function-pointer comparator
+    Sp_Dynamic_Array(int) da = {0};
+    for (int i = 0; i < 777; ++i) {
+        sp_da_push(&da, (i * 389) % 777);
+    }
+    Sp_Heap_D(int, 4) ints = {0};
+    sp_heap_from_array(&ints, &da);
+    assert_true((uintptr_t) &ints.data[1] % SP_CACHE_LINE == 0);
+    for (int i = 0; i < 777; ++i) {
+        assert_true(sp_heap_top(&ints) == i);
+        sp_heap_pop(&ints);
+    }
+    sp_heap_free(&ints);
+}
+
+#define SPTL_TEST_IHEAP_LIVE 300
 
-    uint16_t subtractor = 256;
-    bool state = false;
+typedef Sp_Indexed_Heap(int) sptl_test_iheap_int;
 
-    while (val > 0) {
-        if (val - subtractor < 0) {
-            // bit is 0
-            if (state) {
-                sp_sb_appendf(&sp, "%c", '0');
+/* Checks the heap order and that `handles` and `slots` agree with each other and with the reference keys. */
+static void sptl_test_iheap_check(const sptl_test_iheap_int *heap, const int *keys, const char *live) {
+    size_t live_count = 0;
+    for (Sp_Heap_Handle h = 0; h < heap->handle_count; ++h) {
+        assert_true(sp_iheap_contains(heap, h) == live[h]);
+        if (live[h]) {
+            assert_true(sp_iheap_get(heap, h) == keys[h]);
+            ++live_count;
+        }
+    }
+    assert_true(live_count == heap->count);
+    for (size_t i = 0; i < heap->count; ++i) {
+        assert_true(heap->slots[heap->handles[i]] == i);
+        if (i > 0) {
+            assert_true(heap->data[sp_bt_node_parent_idx(i)] <= heap->data[i]);
+        }
+    }
+}
+
+static void sptl_test_iheap(void **state) {
+    (void) state;
+
+    sptl_test_allocator__stats stats = {0};
+    const Sp_Allocator allocator = {
+        .alloc = sptl_test_allocator__alloc,
+        .free = sptl_test_allocator__free,
+        .ctx = &stats,
+    };
+
+    // Random pushes, pops, key changes and removals against per-handle reference keys
+    sptl_test_iheap_int heap = {.allocator = &allocator};
+    int keys[SPTL_TEST_IHEAP_LIVE + 1] = {0};
+    char live[SPTL_TEST_IHEAP_LIVE + 1] = {0};
+    uint64_t x = 88172645463325252ull;
+    for (int op = 0; op < 20000; ++op) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        const int delta = (int) (x >> 40) % 1000;
+        Sp_Heap_Handle h = (Sp_Heap_Handle) ((x >> 20) % (heap.handle_count ? heap.handle_count : 1));
+        while (heap.count > 0 && !live[h]) {
+            h = (h + 1) % heap.handle_count;
+        }
+        switch (x % 6) {
+        case 0:
+        case 1:
+            if (heap.count < SPTL_TEST_IHEAP_LIVE) {
+                sp_iheap_push(&heap, delta, &h);
+                assert_true(!live[h]);
+                live[h] = 1;
+                keys[h] = delta;
             }
-        } else {
-            // bit is 1
-            sp_sb_appendf(&sp, "%c", '1');
-            state = true;
-            val -= subtractor;
+            break;
+        case 2:
+            if (heap.count > 0) {
+                keys[h] -= delta;
+                sp_iheap_decrease_key(&heap, h, keys[h]);
+            }
+            break;
+        case 3:
+            if (heap.count > 0) {
+                keys[h] += delta;
+                sp_iheap_increase_key(&heap, h, keys[h]);
+            }
+            break;
+        case 4:
+            if (heap.count > 0) {
+                keys[h] = delta;
+                sp_iheap_update(&heap, h, keys[h]);
+            }
+            break;
+        default:
+            if (heap.count > 0 && op % 2) {
+                sp_iheap_remove(&heap, h);
+                live[h] = 0;
+            } else if (heap.count > 0) {
+                const Sp_Heap_Handle top = sp_iheap_top_handle(&heap);
+                for (Sp_Heap_Handle i = 0; i < heap.handle_count; ++i) {
+                    assert_true(!live[i] || keys[i] >= sp_iheap_top(&heap));
+                }
+                assert_true(keys[top] == sp_iheap_top(&heap));
+                sp_iheap_pop(&heap);
+                live[top] = 0;
+            }
+            break;
+        }
+        if (op % 97 == 0) {
+            sptl_test_iheap_check(&heap, keys, live);
         }
+    }
+    sptl_test_iheap_check(&heap, keys, live);
+
+    // Freed handles are reused, so the index never outgrows the most entries live at once
+    assert_true(heap.handle_count <= SPTL_TEST_IHEAP_LIVE);
+    int previous = INT_MIN;
+    while (heap.count > 0) {
+        assert_true(sp_iheap_top(&heap) >= previous);
+        previous = sp_iheap_top(&heap);
+        sp_iheap_pop(&heap);
+    }
+    sp_iheap_free(&heap);
+    assert_true(stats.live_bytes == 0);
+
+    // Cancelling and rescheduling timers in a 4-ary heap with an inlined comparator
+    Sp_Indexed_Heap_D(sptl_test_timer, 4) timers = {0};
+    Sp_Heap_Handle handles[5];
+    for (uint32_t i = 0; i < 5; ++i) {
+        sp_iheap_push_by(&timers, ((sptl_test_timer) {.deadline = 10 * (i + 1), .id = i}), &handles[i],
+                         sptl_test_timer_earlier);
+    }
+    sp_iheap_remove_by(&timers, handles[0], sptl_test_timer_earlier);
+    assert_true(!sp_iheap_contains(&timers, handles[0]));
+    sp_iheap_update_by(&timers, handles[4], ((sptl_test_timer) {.deadline = 5, .id = 4}), sptl_test_timer_earlier);
+    sp_iheap_update_by(&timers, handles[1], ((sptl_test_timer) {.deadline = 45, .id = 1}), sptl_test_timer_earlier);
+    const uint32_t order[] = {4, 2, 3, 1};
+    for (size_t i = 0; i < 4; ++i) {
+        assert_true(sp_iheap_top(&timers).id == order[i]);
+        assert_true(sp_iheap_top_handle(&timers) == handles[order[i]]);
+        sp_iheap_pop_by(&timers, sptl_test_timer_earlier);
+    }
+    assert_true(timers.count == 0 && timers.handle_count == 5);
+    sp_iheap_free(&timers);
+}
+
+static void sptl_test_allocator(void **state) {
+    (void) state;
+
+    // No realloc: growth goes through the alloc + copy + free fallback.
+    sptl_test_allocator__stats stats = {0};
+    const Sp_Allocator allocator = {
+        .alloc = sptl_test_allocator__alloc,
+        .free = sptl_test_allocator__free,
+        .ctx = &stats,
+    };
+
+    Sp_Dynamic_Array(int) da = {.allocator = &allocator};
+    for (int i = 0; i < 1000; ++i) {
+        sp_da_push(&da, i);
+    }
+    for (int i = 0; i < 1000; ++i) {
+        assert_true(da.data[i] == i);
+    }
+    assert_true(stats.live_bytes == da.capacity * sizeof(*da.data));
+    sp_da_free(&da);
+    assert_true(stats.live_bytes == 0);
+    assert_true(da.allocator == &allocator);
+
+    Sp_Queue(int) queue = {.allocator = &allocator};
+    for (int i = 0; i < 100; ++i) {
+        sp_queue_push(&queue, i);
+    }
+    sp_queue_free(&queue);
+    assert_true(stats.live_bytes == 0);
+
+    Sp_Linked_List(int) ll = {.allocator = &allocator};
+    for (int i = 0; i < 10; ++i) {
+        sp_ll_push_back(&ll, i);
+        sp_ll_push_front(&ll, i);
+    }
+    for (int i = 0; i < 10; ++i) {
+        sp_ll_pop_back(&ll);
+        sp_ll_pop_front(&ll);
+    }
+    sp_ll_free(&ll);
+    assert_true(stats.live_bytes == 0);
+
+    Sp_Hash_Table(int, int) ht = {.allocator = &allocator, .incremental = 1};
+    for (int i = 0; i < 1000; ++i) {
+        sp_ht_insert(&ht, i, i);
+    }
+    sp_ht_free(&ht);
+    assert_true(stats.live_bytes == 0);
+
+    Sp_Heap(int) heap = {.allocator = &allocator};
+    for (int i = 100; i > 0; --i) {
+        sp_heap_push(&heap, i);
+    }
+    assert_true(sp_heap_top(&heap) == 1);
+    sp_heap_free(&heap);
+    assert_true(stats.live_bytes == 0);
+
+    Sp_String_Builder sb = {.allocator = &allocator};
+    sp_sb_appendf(&sb, "%d-%s", 42, "allocator");
+    assert_true(strcmp(sb.data, "42-allocator") == 0);
+    sp_da_free(&sb);
+    assert_true(stats.live_bytes == 0);
 
-        subtractor >>= 1;
+    assert_true(stats.allocs > 0);
+}
+
+static void sptl_test_arena(void **state) {
+    (void) state;
+
+    sptl_test_allocator__stats stats = {0};
+    const Sp_Allocator backing = {
+        .alloc = sptl_test_allocator__alloc,
+        .free = sptl_test_allocator__free,
+        .ctx = &stats,
+    };
+    Sp_Arena arena = {.chunk_size = 1024, .backing = &backing};
+
+    // Alignment
+    char *byte = sp_arena_alloc_aligned(&arena, 1, 1);
+    double *dbl = sp_arena_new(&arena, double, 4);
+    void *page = sp_arena_alloc_aligned(&arena, 16, 256);
+    assert_true(byte != NULL);
+    assert_true((uintptr_t) dbl % _Alignof(double) == 0);
+    assert_true((uintptr_t) page % 256 == 0);
+    assert_true(stats.allocs == 1);
+
+    // Marks
+    Sp_Arena_Mark mark = sp_arena_mark(&arena);
+    int *first = sp_arena_new(&arena, int, 8);
+    sp_arena_alloc(&arena, 4096); // oversized, gets its own chunk
+    sp_arena_restore(&arena, mark);
+    assert_true(sp_arena_new(&arena, int, 8) == first);
+
+    // Containers, grown in place at the top of the arena
+    sp_arena_reset(&arena);
+    const size_t chunk_allocs = stats.allocs;
+    Sp_Dynamic_Array(int) da = {.allocator = sp_arena_allocator(&arena)};
+    for (int i = 0; i < 200; ++i) {
+        sp_da_push(&da, i);
+    }
+    for (int i = 0; i < 200; ++i) {
+        assert_true(da.data[i] == i);
     }
+    assert_true((void *) da.data == (void *) arena.first->data);
 
+    Sp_String_Builder sb = {.allocator = sp_arena_allocator(&arena)};
+    sp_sb_appendf(&sb, "%s %d", "arena", 9);
+    assert_true(strcmp(sb.data, "arena 9") == 0);
+
+    sp_da_free(&da);
+    sp_da_free(&sb);
+    assert_true(stats.allocs == chunk_allocs); // the 4096 byte chunk was reused
+
+    // Reset reuses every chunk
+    sp_arena_reset(&arena);
+    for (int i = 0; i < 4; ++i) {
+        sp_arena_alloc(&arena, 1000);
+    }
+    assert_true(stats.allocs == chunk_allocs);
+
+    sp_arena_free(&arena);
+    assert_true(stats.live_bytes == 0);
+}
+
+static inline Sp_String_Builder uint8_to_binary_str(uint8_t val) {
+    Sp_String_Builder sp = {0};
+    sp_sb_append_binary(&sp, val);
     return sp;
 }
 
@@ -443,40 +1943,313 @@ static void sptl_test_bitset(void **state) {
     sp_bitset_free(&bitset);
 }
 
+static void sptl_test_bitset_ranges(void **state) {
+    (void) state;
+
+    Sp_Bitset bitset = {0};
+
+    sp_bitset_set_range(&bitset, 3, 200);
+    assert_true(sp_bitset_count(&bitset) == 197);
+    assert_true(!sp_bitset_check(&bitset, 2) && sp_bitset_check(&bitset, 3));
+    assert_true(sp_bitset_check(&bitset, 199) && !sp_bitset_check(&bitset, 200));
+
+    sp_bitset_clear_range(&bitset, 60, 130);
+    assert_true(sp_bitset_count(&bitset) == 197 - 70);
+    assert_true(sp_bitset_find_next(&bitset, 60) == 130);
+    sp_bitset_clear_range(&bitset, 64, 64); // empty
+    sp_bitset_clear_range(&bitset, 150, 100000); // past the end
+    assert_true(sp_bitset_count(&bitset) == 57 + 20);
+
+    sp_bitset_set_range(&bitset, 64, 128); // exactly one word
+    assert_true(bitset.bits.data[1] == UINT64_MAX);
+
+    // Iteration visits exactly the set bits, in order
+    size_t visited = 0, prev = 0;
+    for (size_t i = sp_bitset_find_first(&bitset); i != SP_BITSET_NPOS; i = sp_bitset_find_next(&bitset, i + 1)) {
+        assert_true(sp_bitset_check(&bitset, i));
+        assert_true(visited == 0 || i > prev);
+        prev = i;
+        ++visited;
+    }
+    assert_true(visited == sp_bitset_count(&bitset));
+    assert_true(sp_bitset_find_next(&bitset, 1000000) == SP_BITSET_NPOS);
+
+    sp_bitset_free(&bitset);
+    assert_true(sp_bitset_find_first(&bitset) == SP_BITSET_NPOS);
+}
+
+static void sptl_test_bitset_bulk(void **state) {
+    (void) state;
+
+    Sp_Bitset evens = {0}, threes = {0}, tmp = {0};
+    for (size_t i = 0; i < 1000; i += 2) {
+        sp_bitset_set(&evens, i);
+    }
+    for (size_t i = 0; i < 600; i += 3) {
+        sp_bitset_set(&threes, i);
+    }
+
+    sp_bitset_or(&tmp, &evens);
+    sp_bitset_and(&tmp, &threes); // multiples of 6 below 600
+    assert_true(sp_bitset_count(&tmp) == 100);
+    assert_true(!sp_bitset_check(&tmp, 606));
+
+    sp_bitset_or(&tmp, &threes); // multiples of 3 below 600
+    assert_true(sp_bitset_count(&tmp) == 200);
+
+    sp_bitset_xor(&tmp, &evens); // odd multiples of 3 below 600, and evens that are not multiples of 3
+    for (size_t i = 0; i < 1000; ++i) {
+        assert_true(sp_bitset_check(&tmp, i) == ((i < 600 && i % 3 == 0) != (i % 2 == 0)));
+    }
+
+    sp_bitset_andnot(&tmp, &evens); // odd multiples of 3
+    assert_true(sp_bitset_count(&tmp) == 100);
+    assert_true(sp_bitset_find_first(&tmp) == 3);
+
+    sp_bitset_xor(&tmp, &tmp);
+    assert_true(sp_bitset_count(&tmp) == 0);
+
+    sp_bitset_free(&evens);
+    sp_bitset_free(&threes);
+    sp_bitset_free(&tmp);
+}
+
+static void sptl_test_bloom(void **state) {
+    (void) state;
+
+    const size_t n = 20000;
+    Sp_Bloom odd = {0}, even = {0};
+    sp_bloom_init(&odd, n, 0.01);
+    sp_bloom_init(&even, n, 0.01);
+    assert_true((uintptr_t) (odd.bits.bits.data + odd.offset) % 64 == 0);
+    assert_true(odd.k == 7);
+
+    for (uint64_t i = 0; i < 2 * n; i += 2) {
+        const uint64_t key = i + 1;
+        sp_bloom_add_bytes(&odd, &key, sizeof(key));
+        sp_bloom_add_hash(&even, sp_hash_u64(i, 0));
+    }
+
+    // No false negatives, and false positives stay near the requested rate
+    size_t false_positives = 0;
+    for (uint64_t i = 0; i < 2 * n; i += 2) {
+        const uint64_t key = i + 1;
+        assert_true(sp_bloom_contains_bytes(&odd, &key, sizeof(key)));
+        assert_true(sp_bloom_contains_hash(&even, sp_hash_u64(i, 0)));
+        false_positives += (size_t) sp_bloom_contains_hash(&even, sp_hash_u64(i + 1, 0));
+    }
+    assert_true(false_positives < n / 50);
+
+    // Hashing once for both the filter and the table
+    Sp_Hash_Table(Sp_Hashed_View, int) ht = {0};
+    const Sp_Hashed_View bob = SP_HASHED_LIT("Bob");
+    sp_ht_insert(&ht, bob, 1);
+    sp_bloom_add_hash(&odd, sp_ht_hash_key(&ht, &bob));
+    assert_true(sp_bloom_contains_hash(&odd, bob.hash));
+    sp_ht_free(&ht);
+
+    // A merged filter answers for both key sets
+    sp_bloom_merge(&even, &odd);
+    for (uint64_t i = 0; i < 2 * n; ++i) {
+        assert_true(sp_bloom_contains_hash(&even, sp_hash_u64(i, 0)) || i % 2 == 1);
+        assert_true(sp_bloom_contains_bytes(&even, &i, sizeof(i)) || i % 2 == 0);
+    }
+
+    sp_bloom_free(&odd);
+    sp_bloom_free(&even);
+
+    // Low rates are met too: about 20 false positives expected from 2M absent keys at 1e-5
+    Sp_Bloom tight = {0};
+    sp_bloom_init(&tight, n, 1e-5);
+    for (uint64_t i = 0; i < n; ++i) {
+        sp_bloom_add_hash(&tight, sp_hash_u64(i, 0));
+    }
+    false_positives = 0;
+    for (uint64_t i = n; i < n + 2000000; ++i) {
+        false_positives += (size_t) sp_bloom_contains_hash(&tight, sp_hash_u64(i, 0));
+    }
+    assert_true(false_positives < 60);
+    sp_bloom_free(&tight);
+}
+
+static void sptl_test_roaring(void **state) {
+    (void) state;
+
+    sptl_test_allocator__stats stats = {0};
+    const Sp_Allocator allocator = {
+        .alloc = sptl_test_allocator__alloc,
+        .free = sptl_test_allocator__free,
+        .ctx = &stats,
+    };
+    Sp_Roaring r = {.allocator = &allocator};
+
+    // Sparse IDs spread over the whole 32-bit range only pay for their containers
+    const uint32_t sparse[] = {7, 65535, 65536, 1u << 24, 4000000000u, UINT32_MAX};
+    for (size_t i = 0; i < sizeof(sparse) / sizeof(*sparse); ++i) {
+        assert_true(sp_roaring_add(&r, sparse[i]));
+    }
+    assert_true(!sp_roaring_add(&r, 4000000000u));
+    assert_true(sp_roaring_cardinality(&r) == 6);
+    assert_true(r.containers.count == 5);
+    assert_true(sp_roaring_contains(&r, UINT32_MAX) && !sp_roaring_contains(&r, 4000000001u));
+
+    Sp_Roaring_Iter it = sp_roaring_iter(&r);
+    uint32_t value;
+    for (size_t i = 0; i < sizeof(sparse) / sizeof(*sparse); ++i) {
+        assert_true(sp_roaring_iter_next(&it, &value) && value == sparse[i]);
+    }
+    assert_true(!sp_roaring_iter_next(&it, &value));
+
+    // Growing a container past the array limit switches it to a bitmap, shrinking it switches back
+    for (uint32_t i = 0; i < 3 * SP_ROARING_ARRAY_MAX; i += 3) {
+        sp_roaring_add(&r, 0x10000 + i);
+    }
+    int found;
+    Sp_Roaring_Container *c = &r.containers.data[__sp_roaring_find(&r, 1, &found)];
+    assert_true(found && c->kind == SP_ROARING_ARRAY && c->cardinality == SP_ROARING_ARRAY_MAX);
+    sp_roaring_add(&r, 0x10001);
+    assert_true(c->kind == SP_ROARING_BITMAP && c->cardinality == SP_ROARING_ARRAY_MAX + 1);
+    assert_true(sp_roaring_contains(&r, 0x10001) && sp_roaring_contains(&r, 0x10000 + 3 * 100));
+    assert_true(sp_roaring_remove(&r, 0x10001) && !sp_roaring_remove(&r, 0x10001));
+    assert_true(c->kind == SP_ROARING_ARRAY && !sp_roaring_contains(&r, 0x10001));
+
+    // Removing the last member drops the container
+    assert_true(sp_roaring_remove(&r, 7));
+    assert_true(r.containers.count == 5 && r.containers.data[0].key == 0);
+    assert_true(sp_roaring_remove(&r, 65535));
+    assert_true(r.containers.count == 4 && r.containers.data[0].key == 1);
+
+    sp_roaring_free(&r);
+    assert_true(stats.live_bytes == 0);
+}
+
+static void sptl_test_roaring_set_ops(void **state) {
+    (void) state;
+
+    Sp_Roaring a = {0}, b = {0}, runs = {0};
+    for (uint32_t i = 0; i < 200000; i += 2) {
+        sp_roaring_add(&a, i);
+    }
+    for (uint32_t i = 0; i < 300000; i += 3) {
+        sp_roaring_add(&b, i);
+    }
+    for (uint32_t i = 100000; i < 250000; ++i) {
+        sp_roaring_add(&runs, i);
+    }
+    sp_roaring_add(&runs, 5);
+
+    // Dense ranges compress to a handful of runs without changing membership; the lone 5 stays an array
+    sp_roaring_optimize(&runs);
+    assert_true(runs.containers.data[0].kind == SP_ROARING_ARRAY);
+    for (size_t i = 1; i < runs.containers.count; ++i) {
+        assert_true(runs.containers.data[i].kind == SP_ROARING_RUN);
+    }
+    assert_true(sp_roaring_cardinality(&runs) == 150001);
+    assert_true(sp_roaring_contains(&runs, 5) && !sp_roaring_contains(&runs, 6));
+    assert_true(sp_roaring_contains(&runs, 249999) && !sp_roaring_contains(&runs, 250000));
+    Sp_Roaring_Iter it = sp_roaring_iter(&runs);
+    uint32_t value, expected = 100000;
+    assert_true(sp_roaring_iter_next(&it, &value) && value == 5);
+    while (sp_roaring_iter_next(&it, &value)) {
+        assert_true(value == expected++);
+    }
+    assert_true(expected == 250000);
+
+    Sp_Roaring tmp = {0};
+    sp_roaring_or(&tmp, &a);
+    sp_roaring_and(&tmp, &b); // multiples of 6 below 200000
+    assert_true(sp_roaring_cardinality(&tmp) == 33334);
+    sp_roaring_and(&tmp, &runs); // multiples of 6 in [100000, 200000)
+    assert_true(sp_roaring_cardinality(&tmp) == 16667);
+    assert_true(!sp_roaring_contains(&tmp, 99996) && sp_roaring_contains(&tmp, 100002));
+
+    sp_roaring_or(&tmp, &runs);
+    assert_true(sp_roaring_cardinality(&tmp) == 150001);
+    sp_roaring_or(&tmp, &b);
+    for (uint32_t i = 0; i < 320000; ++i) {
+        const int member = i == 5 || (i >= 100000 && i < 250000) || (i < 300000 && i % 3 == 0);
+        assert_true(sp_roaring_contains(&tmp, i) == member);
+    }
+
+    sp_roaring_free(&a);
+    sp_roaring_free(&b);
+    sp_roaring_free(&runs);
+    sp_roaring_free(&tmp);
+}
+
 static const struct CMUnitTest sptl_tests[] = {
     /* Sp_Dynamic_Array */
     cmocka_unit_test(sptl_test_da_resize),
     cmocka_unit_test(sptl_test_da_pop_overflow),
     cmocka_unit_test(sptl_test_da_pop_shrink),
+    cmocka_unit_test(sptl_test_da_shrink_hysteresis),
+    cmocka_unit_test(sptl_test_da_shrink_to_fit),
 
     /* Sp_String_Builder */
     cmocka_unit_test(sptl_test_sb_appendf),
+    cmocka_unit_test(sptl_test_sb_append),
+    cmocka_unit_test(sptl_test_sb_append_numbers),
 
     /* Sp_String_Slice */
     cmocka_unit_test(sptl_test_sv),
+    cmocka_unit_test(sptl_test_sv_find),
+    cmocka_unit_test(sptl_test_sv_split_trim),
+    cmocka_unit_test(sptl_test_sv_lines),
+    cmocka_unit_test(sptl_test_file_map),
 
     /* Sp_Linked_List */
     cmocka_unit_test(sptl_test_ll_push_pop_back),
     cmocka_unit_test(sptl_test_ll_push_pop_front),
+    cmocka_unit_test(sptl_test_ll_pool),
+
+    /* Sp_Unrolled_List */
+    cmocka_unit_test(sptl_test_ul_push_pop),
+    cmocka_unit_test(sptl_test_ul_splice),
 
     /* Sp_Queue */
     cmocka_unit_test(sptl_test_queue_pop_overflow),
     cmocka_unit_test(sptl_test_queue_push_peek_pop),
+    cmocka_unit_test(sptl_test_queue_bulk),
+    cmocka_unit_test(sptl_test_spsc_ring),
+    cmocka_unit_test(sptl_test_mpmc_ring),
 
     /* Sp_Hash_Table */
     cmocka_unit_test(sptl_test_ht_insert),
+    cmocka_unit_test(sptl_test_ht_mut_str_keys),
+    cmocka_unit_test(sptl_test_ht_float_keys),
     cmocka_unit_test(sptl_test_ht_dup_insert),
     cmocka_unit_test(sptl_test_ht_sv_insert),
+    cmocka_unit_test(sptl_test_ht_grow),
+    cmocka_unit_test(sptl_test_ht_remove),
+    cmocka_unit_test(sptl_test_ht_churn),
+    cmocka_unit_test(sptl_test_ht_get_or_insert),
+    cmocka_unit_test(sptl_test_ht_incremental),
+    cmocka_unit_test(sptl_test_ht_int_keys),
+    cmocka_unit_test(sptl_test_ht_pod_keys),
+    cmocka_unit_test(sptl_test_ht_custom_hash),
+    cmocka_unit_test(sptl_test_ht_hashed_keys),
+    cmocka_unit_test(sptl_test_hash_bytes),
+    cmocka_unit_test(sptl_test_intern),
 
     /* Sp_Min_Heap */
     cmocka_unit_test(sptl_test_mh_insert),
     cmocka_unit_test(sptl_test_mh_expand),
+    cmocka_unit_test(sptl_test_heap_bulk),
+    cmocka_unit_test(sptl_test_heap_dary),
+    cmocka_unit_test(sptl_test_iheap),
     
     /* Sp_Bitset */
     cmocka_unit_test(sptl_test_bitset),
+    cmocka_unit_test(sptl_test_bitset_ranges),
+    cmocka_unit_test(sptl_test_bitset_bulk),
+    cmocka_unit_test(sptl_test_bloom),
+    cmocka_unit_test(sptl_test_roaring),
+    cmocka_unit_test(sptl_test_roaring_set_ops),
 
     /* Miscellaneous */
     cmocka_unit_test(sptl_test_sb_binary),
+    cmocka_unit_test(sptl_test_allocator),
+    cmocka_unit_test(sptl_test_arena),
     cmocka_unit_test(sptl_test_pair),
 
 };
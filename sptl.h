@@ -5,11 +5,33 @@
 #include <errno.h>
 #include <limits.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#if !defined(SP_NO_MMAP) && (defined(__unix__) || defined(__APPLE__))
+#define SP_HAS_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if !defined(__STDC_NO_ATOMICS__)
+#define SP_HAS_ATOMICS
+#include <stdatomic.h>
+#endif
+
 #if defined(_WIN32) && !defined(SP_STATIC)
 #if defined(SP_WIN32_EXPORT)
 #define SPExtern __declspec(dllexport)
@@ -25,6 +47,8 @@
 
 #define macro_var(id) CONCAT(id, __LINE__)
 
+#define SP_CACHE_LINE 64 // bytes; used to align and pad hot shared data
+
 #if defined(__GNUC__) || defined(__clang__)
 #define sp_unreachable()                                                                       \
     do {                                                                                       \
@@ -129,15 +153,227 @@ __attribute__((format(printf, 2, 3))) static inline void sp_die(int code, const
 #define sp_pair_ptr_params(name, Ta, Tb) Ta *CONCAT(name, _left), Tb *CONCAT(name, _right)
 #define sp_pair_ptr_arg(pair) &(pair)->left, &(pair)->right
 
+/*
+ * Default heap functions behind every container, overridable before including sptl.h (all four together).
+ */
+#if !defined(SP_MALLOC) && !defined(SP_CALLOC) && !defined(SP_REALLOC) && !defined(SP_FREE)
+#define SP_MALLOC malloc
+#define SP_CALLOC calloc
+#define SP_REALLOC realloc
+#define SP_FREE free
+#elif !defined(SP_MALLOC) || !defined(SP_CALLOC) || !defined(SP_REALLOC) || !defined(SP_FREE)
+#error "SP_MALLOC, SP_CALLOC, SP_REALLOC and SP_FREE must be defined together"
+#endif
+
+/*
+ * Allocator interface carried by every container in its `allocator` field; NULL (the zero-initialized default)
+ * routes through `SP_MALLOC`/`SP_CALLOC`/`SP_REALLOC`/`SP_FREE`. The allocator outlives every container using it,
+ * and a container keeps its allocator across `*_free()` so it can be reused.
+ *
+ * `realloc` and `free` may be NULL: reallocation then falls back to alloc + copy, and freeing becomes a no-op
+ * (e.g. for region allocators that release everything at once). Sizes are passed back on realloc/free so that
+ * allocators do not need to store them.
+ */
+typedef struct Sp_Allocator {
+    void *(*alloc)(void *ctx, size_t bytes);
+    void *(*realloc)(void *ctx, void *ptr, size_t old_bytes, size_t new_bytes);
+    void (*free)(void *ctx, void *ptr, size_t bytes);
+    void *ctx;
+} Sp_Allocator;
+
+static inline void *sp_alloc(const Sp_Allocator *allocator, size_t bytes) {
+    void *ptr = allocator ? allocator->alloc(allocator->ctx, bytes) : SP_MALLOC(bytes);
+    assert(ptr);
+    return ptr;
+}
+
+static inline void *sp_alloc_zeroed(const Sp_Allocator *allocator, size_t count, size_t type_size) {
+    if (!allocator) {
+        void *ptr = SP_CALLOC(count, type_size);
+        assert(ptr);
+        return ptr;
+    }
+    void *ptr = sp_alloc(allocator, count * type_size);
+    memset(ptr, 0, count * type_size);
+    return ptr;
+}
+
+static inline void *sp_realloc(const Sp_Allocator *allocator, void *ptr, size_t old_bytes, size_t new_bytes) {
+    void *alloc;
+    if (!allocator) {
+        alloc = SP_REALLOC(ptr, new_bytes);
+    } else if (allocator->realloc) {
+        alloc = allocator->realloc(allocator->ctx, ptr, old_bytes, new_bytes);
+    } else {
+        alloc = allocator->alloc(allocator->ctx, new_bytes);
+        if (ptr && alloc) {
+            memcpy(alloc, ptr, old_bytes < new_bytes ? old_bytes : new_bytes);
+            if (allocator->free) allocator->free(allocator->ctx, ptr, old_bytes);
+        }
+    }
+    assert(alloc);
+    return alloc;
+}
+
+static inline void sp_free(const Sp_Allocator *allocator, void *ptr, size_t bytes) {
+    if (!ptr) {
+        return;
+    }
+    if (!allocator) {
+        SP_FREE(ptr);
+    } else if (allocator->free) {
+        allocator->free(allocator->ctx, ptr, bytes);
+    }
+}
+
+/*
+ * Region allocator: allocations are bumped out of chunks and released all at once by `sp_arena_reset()` (chunks
+ * are kept for reuse) or `sp_arena_free()`. Zero-initialize before use; the arena must not move while memory
+ * or its allocator is in use.
+ *
+ * Containers draw from an arena by setting `.allocator = sp_arena_allocator(&arena)`. Their `*_free()` then
+ * becomes a no-op and the whole lot is reclaimed by the next reset.
+ */
+#ifndef SP_ARENA_CHUNK_SIZE
+#define SP_ARENA_CHUNK_SIZE (64 * 1024)
+#endif
+#define SP_ARENA_ALIGN _Alignof(max_align_t)
+
+typedef struct Sp_Arena_Chunk {
+    struct Sp_Arena_Chunk *next;
+    size_t capacity;
+    size_t used;
+    _Alignas(max_align_t) unsigned char data[];
+} Sp_Arena_Chunk;
+
+typedef struct Sp_Arena {
+    Sp_Arena_Chunk *first;
+    Sp_Arena_Chunk *current;
+    size_t chunk_size; // 0 selects SP_ARENA_CHUNK_SIZE
+    const Sp_Allocator *backing;
+    Sp_Allocator allocator;
+} Sp_Arena;
+
+/* Position in an arena; restoring it releases everything allocated after it was taken. */
+typedef struct Sp_Arena_Mark {
+    Sp_Arena_Chunk *chunk;
+    size_t used;
+} Sp_Arena_Mark;
+
+/* Offset of the first `align`-aligned byte at or after `chunk->data + chunk->used`. */
+static inline size_t __sp_arena_aligned_offset(const Sp_Arena_Chunk *chunk, size_t align) {
+    const uintptr_t ptr = (uintptr_t) (chunk->data + chunk->used);
+    return chunk->used + (size_t) (((ptr + align - 1) & ~(uintptr_t) (align - 1)) - ptr);
+}
+
+static inline void *sp_arena_alloc_aligned(Sp_Arena *arena, size_t bytes, size_t align) {
+    assert(align > 0 && (align & (align - 1)) == 0);
+
+    if (arena->current) {
+        size_t offset = __sp_arena_aligned_offset(arena->current, align);
+        if (offset + bytes <= arena->current->capacity) {
+            arena->current->used = offset + bytes;
+            return arena->current->data + offset;
+        }
+    }
+
+    // Move on to the next retained chunk when it is large enough, otherwise splice a fresh one in after `current`.
+    const size_t needed = bytes + (align > SP_ARENA_ALIGN ? align : 0);
+    Sp_Arena_Chunk *next = arena->current ? arena->current->next : arena->first;
+    if (!next || next->capacity < needed) {
+        size_t capacity = arena->chunk_size ? arena->chunk_size : SP_ARENA_CHUNK_SIZE;
+        if (capacity < needed) {
+            capacity = needed;
+        }
+        Sp_Arena_Chunk *chunk = sp_alloc(arena->backing, sizeof(Sp_Arena_Chunk) + capacity);
+        chunk->capacity = capacity;
+        chunk->next = next;
+        if (arena->current) {
+            arena->current->next = chunk;
+        } else {
+            arena->first = chunk;
+        }
+        next = chunk;
+    }
+
+    next->used = 0;
+    arena->current = next;
+    size_t offset = __sp_arena_aligned_offset(next, align);
+    next->used = offset + bytes;
+    return next->data + offset;
+}
+
+static inline void *sp_arena_alloc(Sp_Arena *arena, size_t bytes) {
+    return sp_arena_alloc_aligned(arena, bytes, SP_ARENA_ALIGN);
+}
+
+#define sp_arena_new(arena, T, __count__) ((T *) sp_arena_alloc_aligned((arena), (__count__) * sizeof(T), _Alignof(T)))
+
+static inline Sp_Arena_Mark sp_arena_mark(const Sp_Arena *arena) {
+    return (Sp_Arena_Mark) {.chunk = arena->current, .used = arena->current ? arena->current->used : 0};
+}
+
+static inline void sp_arena_restore(Sp_Arena *arena, Sp_Arena_Mark mark) {
+    arena->current = mark.chunk;
+    if (mark.chunk) {
+        mark.chunk->used = mark.used;
+    }
+}
+
+/* Releases every allocation in O(1); chunks are kept and reused by subsequent allocations. */
+static inline void sp_arena_reset(Sp_Arena *arena) { sp_arena_restore(arena, (Sp_Arena_Mark) {0}); }
+
+static inline void sp_arena_free(Sp_Arena *arena) {
+    Sp_Arena_Chunk *chunk = arena->first;
+    while (chunk) {
+        Sp_Arena_Chunk *next = chunk->next;
+        sp_free(arena->backing, chunk, sizeof(Sp_Arena_Chunk) + chunk->capacity);
+        chunk = next;
+    }
+    arena->first = NULL;
+    arena->current = NULL;
+}
+
+static inline void *__sp_arena_allocator_alloc(void *ctx, size_t bytes) { return sp_arena_alloc(ctx, bytes); }
+
+/* Grows the most recent allocation in place when it still fits, which keeps a dynamic array pushed in a loop from
+ * leaving a trail of dead copies behind. */
+static inline void *__sp_arena_allocator_realloc(void *ctx, void *ptr, size_t old_bytes, size_t new_bytes) {
+    Sp_Arena *arena = ctx;
+    Sp_Arena_Chunk *chunk = arena->current;
+    if (ptr && chunk && (unsigned char *) ptr + old_bytes == chunk->data + chunk->used &&
+        (size_t) ((unsigned char *) ptr - chunk->data) + new_bytes <= chunk->capacity) {
+        chunk->used = (size_t) ((unsigned char *) ptr - chunk->data) + new_bytes;
+        return ptr;
+    }
+
+    void *alloc = sp_arena_alloc(arena, new_bytes);
+    if (ptr) {
+        memcpy(alloc, ptr, old_bytes < new_bytes ? old_bytes : new_bytes);
+    }
+    return alloc;
+}
+
+static inline const Sp_Allocator *sp_arena_allocator(Sp_Arena *arena) {
+    arena->allocator = (Sp_Allocator) {
+        .alloc = __sp_arena_allocator_alloc,
+        .realloc = __sp_arena_allocator_realloc,
+        .free = NULL,
+        .ctx = arena,
+    };
+    return &arena->allocator;
+}
+
 /*
  * Standard-issue dynamic array.
  *
  */
-#define Sp_Dynamic_Array(T) \
-    struct {                \
-        T *data;            \
-        size_t count;       \
-        size_t capacity;    \
+#define Sp_Dynamic_Array(T)            \
+    struct {                           \
+        T *data;                       \
+        size_t count;                  \
+        size_t capacity;               \
+        const Sp_Allocator *allocator; \
     }
 
 #define sp_da_type(da) __typeof__((da)->data)
@@ -145,37 +381,59 @@ __attribute__((format(printf, 2, 3))) static inline void sp_die(int code, const
 
 #define SP_DA_INIT_CAP 16
 
+/*
+ * Shrink policy of `sp_da_pop()`: the capacity is halved once `count` drops below `capacity / SP_DA_SHRINK_FACTOR`.
+ * Growth doubles, so right after either resize the array is about half full, and alternating pushes and pops
+ * around one threshold never bounce between two allocations. Define `SP_DA_NO_SHRINK` to never shrink on pop and
+ * release memory explicitly with `sp_da_shrink_to_fit()` instead.
+ */
+#ifndef SP_DA_SHRINK_FACTOR
+#define SP_DA_SHRINK_FACTOR 4
+#endif
+_Static_assert(SP_DA_SHRINK_FACTOR > 2, "SP_DA_SHRINK_FACTOR must leave room between the shrink and grow thresholds");
+
+/*
+ * Resizes the allocation to `new_capacity` elements with `realloc`, which lets the allocator extend a block in
+ * place (or remap large ones) instead of copying it. Shrinking to zero frees the block.
+ */
 #define sp_da_alloc(da, __capacity__) \
-    __sp_da_alloc((void **) &(da)->data, &(da)->capacity, __capacity__, sizeof(*(da)->data))
-static inline void __sp_da_alloc(void **data, size_t *capacity, size_t new_capacity, size_t type_size) {
+    __sp_da_alloc((da)->allocator, (void **) &(da)->data, &(da)->capacity, __capacity__, sizeof(*(da)->data))
+static inline void __sp_da_alloc(const Sp_Allocator *allocator, void **data, size_t *capacity, size_t new_capacity,
+                                 size_t type_size) {
     if (!data || !capacity) {
         return;
     }
 
-    void *alloc = malloc(new_capacity * type_size);
-    assert(alloc);
-
-    if (*data) {
-        memcpy(alloc, *data, ((new_capacity < *capacity ? new_capacity : *capacity) * type_size));
-        free(*data);
+    if (new_capacity == 0) {
+        sp_free(allocator, *data, *capacity * type_size);
+        *data = NULL;
+        *capacity = 0;
+        return;
     }
+
+    void *alloc = sp_realloc(allocator, *data, *capacity * type_size, new_capacity * type_size);
+
     *data = alloc;
     *capacity = new_capacity;
 }
 
-#define sp_da_reserve(da, __expected__)                         \
-    do {                                                        \
-        const size_t macro_var(expected) = (__expected__);      \
-        size_t macro_var(capacity) = (da)->capacity;            \
-        if (macro_var(capacity) < macro_var(expected)) {        \
-            if (macro_var(capacity) == 0) {                     \
-                macro_var(capacity) = macro_var(expected);      \
-            }                                                   \
-            while (macro_var(capacity) < macro_var(expected)) { \
-                macro_var(capacity) *= 2;                       \
-            }                                                   \
-            sp_da_alloc(da, macro_var(capacity));               \
-        }                                                       \
+/* Capacity a dynamic array holding `capacity` elements grows to in order to fit `expected`. */
+static inline size_t __sp_da_grow_capacity(size_t capacity, size_t expected) {
+    if (capacity == 0) {
+        return expected;
+    }
+    while (capacity < expected) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+#define sp_da_reserve(da, __expected__)                                                  \
+    do {                                                                                 \
+        const size_t macro_var(expected) = (__expected__);                               \
+        if ((da)->capacity < macro_var(expected)) {                                      \
+            sp_da_alloc(da, __sp_da_grow_capacity((da)->capacity, macro_var(expected))); \
+        }                                                                                \
     } while (0)
 
 #define sp_da_resize(da, __count__)                                                           \
@@ -196,17 +454,29 @@ static inline void __sp_da_alloc(void **data, size_t *capacity, size_t new_capac
         (da)->data[(da)->count++] = element;                                 \
     } while (0)
 
-#define sp_da_pop(da)                                                  \
-    do {                                                               \
-        if (!(da)->data || (da)->count == 0) break;                    \
-        if ((da)->count > 0)                                           \
-            --(da)->count;                                             \
-        (da)->data[(da)->count] = (__typeof__(*(da)->data)) {0};       \
-        if ((da)->count < (size_t) (0.25 * (double) (da)->capacity)) { \
-            sp_da_alloc(da, (da)->capacity / 2);                       \
-        }                                                              \
+#ifdef SP_DA_NO_SHRINK
+#define __sp_da_shrink_on_pop(da) ((void) 0)
+#else
+#define __sp_da_shrink_on_pop(da)                                 \
+    do {                                                          \
+        if ((da)->count < (da)->capacity / SP_DA_SHRINK_FACTOR) { \
+            sp_da_alloc(da, (da)->capacity / 2);                  \
+        }                                                         \
+    } while (0)
+#endif
+
+#define sp_da_pop(da)                                            \
+    do {                                                         \
+        if (!(da)->data || (da)->count == 0) break;              \
+        if ((da)->count > 0)                                     \
+            --(da)->count;                                       \
+        (da)->data[(da)->count] = (__typeof__(*(da)->data)) {0}; \
+        __sp_da_shrink_on_pop(da);                               \
     } while (0)
 
+/* Reallocates the array down to exactly `count` elements, freeing it entirely when empty. */
+#define sp_da_shrink_to_fit(da) sp_da_alloc((da), (da)->count)
+
 /*
  * Clears the dynamic array, but does NOT free it.
  */
@@ -217,10 +487,12 @@ static inline void __sp_da_alloc(void **data, size_t *capacity, size_t new_capac
         (da)->count = 0;                                             \
     } while (0)
 
-#define sp_da_free(da)                  \
-    do {                                \
-        free((da)->data);               \
-        memset((da), 0, sizeof(*(da))); \
+#define sp_da_free(da)                                                                      \
+    do {                                                                                    \
+        const Sp_Allocator *macro_var(da_allocator) = (da)->allocator;                      \
+        sp_free(macro_var(da_allocator), (da)->data, (da)->capacity * sizeof(*(da)->data)); \
+        memset((da), 0, sizeof(*(da)));                                                     \
+        (da)->allocator = macro_var(da_allocator);                                          \
     } while (0)
 
 typedef Sp_Dynamic_Array(char) Sp_String_Builder;
@@ -231,51 +503,432 @@ typedef Sp_Dynamic_Array(char) Sp_String_Builder;
  * Increments `sb->count` by the length of parsed `format` excluding the null terminator, but `sb->data`
  * itself is safe-to-use.
  */
-__attribute__((format(printf, 2, 3))) static inline int sp_sb_appendf(Sp_String_Builder *sb, const char *format, ...) {
-    va_list arg;
+__attribute__((format(printf, 2, 0))) static inline int sp_sb_vappendf(Sp_String_Builder *sb, const char *format,
+                                                                       va_list arg) {
+    va_list retry;
+    va_copy(retry, arg);
 
+    // Format straight into the spare capacity; this is the only pass unless the output does not fit.
+    const size_t avail = sb->capacity > sb->count ? sb->capacity - sb->count : 0;
     errno = 0;
+    int count = vsnprintf(avail ? sb->data + sb->count : NULL, avail, format, arg);
+
+    if (count < 0) {
+        va_end(retry);
+        sp_die(1, "sp_sb_appendf: vsnprintf failed (%s)", strerror(errno));
+    }
+
+    if ((size_t) count >= avail) {
+        // Truncated. Format arguments may alias the current buffer (e.g. appending a view of sb onto itself),
+        // so format into the grown buffer before the old one is released rather than realloc'ing in place.
+        const size_t capacity = __sp_da_grow_capacity(sb->capacity, sb->count + (size_t) count + 1);
+        char *data = sp_alloc(sb->allocator, capacity);
+        if (sb->count > 0) {
+            memcpy(data, sb->data, sb->count);
+        }
+        vsnprintf(data + sb->count, (size_t) count + 1, format, retry);
+        sp_free(sb->allocator, sb->data, sb->capacity);
+        sb->data = data;
+        sb->capacity = capacity;
+    }
+    va_end(retry);
+
+    sb->count += (size_t) count; // increased allocated count but not include null terminator
+
+    return count;
+}
+
+__attribute__((format(printf, 2, 3))) static inline int sp_sb_appendf(Sp_String_Builder *sb, const char *format, ...) {
+    va_list arg;
     va_start(arg, format);
-    int count = vsnprintf(NULL, 0, format, arg);
+    int count = sp_sb_vappendf(sb, format, arg);
     va_end(arg);
+    return count;
+}
 
-    if (count < 0) {
-        sp_die(1, "sp_sb_appendf: vsnprintf to determine count failed (%s)", strerror(errno));
+/* Makes room for `extra` more characters plus the null terminator. */
+static inline void __sp_sb_reserve_extra(Sp_String_Builder *sb, size_t extra) {
+    sp_da_reserve(sb, sb->count + extra + 1);
+}
+
+/* Appends `count` raw bytes, which may point into `sb` itself. */
+static inline void sp_sb_append_bytes(Sp_String_Builder *sb, const char *bytes, size_t count) {
+    if (sb->capacity < sb->count + count + 1 && sb->data && bytes >= sb->data && bytes < sb->data + sb->capacity) {
+        // Copying out of the buffer being grown: move into the new buffer before releasing the old one.
+        const size_t capacity = __sp_da_grow_capacity(sb->capacity, sb->count + count + 1);
+        char *data = sp_alloc(sb->allocator, capacity);
+        memcpy(data, sb->data, sb->count);
+        memcpy(data + sb->count, bytes, count);
+        sp_free(sb->allocator, sb->data, sb->capacity);
+        sb->data = data;
+        sb->capacity = capacity;
+    } else {
+        __sp_sb_reserve_extra(sb, count);
+        if (count > 0) {
+            memcpy(sb->data + sb->count, bytes, count);
+        }
     }
+    sb->count += count;
+    sb->data[sb->count] = '\0';
+}
 
-    const size_t req = sb->count + (size_t) count + 1; // room for null terminator
+static inline void sp_sb_append_cstr(Sp_String_Builder *sb, const char *cstr) {
+    sp_sb_append_bytes(sb, cstr, strlen(cstr));
+}
+
+static inline void sp_sb_append_char(Sp_String_Builder *sb, char c) {
+    __sp_sb_reserve_extra(sb, 1);
+    sb->data[sb->count++] = c;
+    sb->data[sb->count] = '\0';
+}
 
-    if (req > sb->capacity) {
-        // Growing may realloc and move sb->data, so a format argument that
-        // aliases the buffer (e.g. appending a view of sb onto itself) would
-        // dangle. Format into a temporary first, then append after the move.
-        char *tmp = malloc((size_t) count + 1);
-        assert(tmp);
+static const char __sp_fmt_digit_pairs[201] = "00010203040506070809"
+                                             "10111213141516171819"
+                                             "20212223242526272829"
+                                             "30313233343536373839"
+                                             "40414243444546474849"
+                                             "50515253545556575859"
+                                             "60616263646566676869"
+                                             "70717273747576777879"
+                                             "80818283848586878889"
+                                             "90919293949596979899";
 
-        va_start(arg, format);
-        vsnprintf(tmp, (size_t) count + 1, format, arg);
-        va_end(arg);
+/* Number of decimal digits in `value` (1 for 0), from its bit length without a division loop. */
+static inline unsigned __sp_fmt_dec_digits(uint64_t value) {
+    static const uint64_t pow10[20] = {
+        0,
+        10ull,
+        100ull,
+        1000ull,
+        10000ull,
+        100000ull,
+        1000000ull,
+        10000000ull,
+        100000000ull,
+        1000000000ull,
+        10000000000ull,
+        100000000000ull,
+        1000000000000ull,
+        10000000000000ull,
+        100000000000000ull,
+        1000000000000000ull,
+        10000000000000000ull,
+        100000000000000000ull,
+        1000000000000000000ull,
+        10000000000000000000ull,
+    };
+    const unsigned t = (unsigned) (64 - __builtin_clzll(value | 1)) * 1233 >> 12; // ~ floor(log10(2^bits))
+    return t + 1 - (value < pow10[t]);
+}
 
-        sp_da_reserve(sb, req);
-        memcpy(sb->data + sb->count, tmp, (size_t) count + 1);
-        free(tmp);
+/* Writes the decimal digits of `value` so that they end right before `end`, two at a time. */
+static inline void __sp_fmt_write_dec(char *end, uint64_t value) {
+    while (value >= 100) {
+        const char *pair = __sp_fmt_digit_pairs + (value % 100) * 2;
+        value /= 100;
+        *--end = pair[1];
+        *--end = pair[0];
+    }
+    if (value >= 10) {
+        *--end = __sp_fmt_digit_pairs[value * 2 + 1];
+        *--end = __sp_fmt_digit_pairs[value * 2];
     } else {
-        // dest starts at sb->count, past any source that aliases [0, count),
-        // so the in-place write cannot overlap its own input.
-        char *dest = sb->data + sb->count;
-        va_start(arg, format);
-        vsnprintf(dest, (size_t) count + 1, format, arg);
-        va_end(arg);
+        *--end = (char) ('0' + value);
     }
+}
 
-    sb->count += (size_t) count; // increased allocated count but not include null terminator
+static inline void sp_sb_append_uint(Sp_String_Builder *sb, uint64_t value) {
+    const unsigned digits = __sp_fmt_dec_digits(value);
+    __sp_sb_reserve_extra(sb, digits);
+    sb->count += digits;
+    __sp_fmt_write_dec(sb->data + sb->count, value);
+    sb->data[sb->count] = '\0';
+}
 
-    return count;
+static inline void sp_sb_append_int(Sp_String_Builder *sb, int64_t value) {
+    const uint64_t magnitude = value < 0 ? 0 - (uint64_t) value : (uint64_t) value;
+    const unsigned digits = __sp_fmt_dec_digits(magnitude) + (value < 0);
+    __sp_sb_reserve_extra(sb, digits);
+    if (value < 0) {
+        sb->data[sb->count] = '-';
+    }
+    sb->count += digits;
+    __sp_fmt_write_dec(sb->data + sb->count, magnitude);
+    sb->data[sb->count] = '\0';
+}
+
+/* Appends `value` in lowercase hexadecimal, without a prefix. */
+static inline void sp_sb_append_hex(Sp_String_Builder *sb, uint64_t value) {
+    const unsigned digits = (unsigned) (64 - __builtin_clzll(value | 1) + 3) / 4;
+    __sp_sb_reserve_extra(sb, digits);
+    sb->count += digits;
+    char *end = sb->data + sb->count;
+    *end = '\0';
+    for (unsigned i = 0; i < digits; ++i, value >>= 4) {
+        *--end = "0123456789abcdef"[value & 0xF];
+    }
+}
+
+/* Appends `value` in binary, without a prefix or leading zeroes. */
+static inline void sp_sb_append_binary(Sp_String_Builder *sb, uint64_t value) {
+    const unsigned digits = (unsigned) (64 - __builtin_clzll(value | 1));
+    __sp_sb_reserve_extra(sb, digits);
+    sb->count += digits;
+    char *end = sb->data + sb->count;
+    *end = '\0';
+    for (unsigned i = 0; i < digits; ++i, value >>= 1) {
+        *--end = (char) ('0' + (value & 1));
+    }
+}
+
+/*
+ * Shortest round-trip double formatting (Grisu2, after Florian Loitsch's "Printing Floating-Point Numbers Quickly
+ * and Accurately with Integers"). The output always parses back to the same double; in rare cases it is one
+ * digit longer than the true shortest representation.
+ */
+typedef struct {
+    uint64_t f;
+    int e;
+} __sp_diy_fp;
+
+static inline __sp_diy_fp __sp_diy_fp_mul(__sp_diy_fp lhs, __sp_diy_fp rhs) {
+    const uint64_t m32 = 0xFFFFFFFFu;
+    const uint64_t a = lhs.f >> 32, b = lhs.f & m32, c = rhs.f >> 32, d = rhs.f & m32;
+    const uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t tmp = (bd >> 32) + (ad & m32) + (bc & m32);
+    tmp += 1u << 31; // round
+    return (__sp_diy_fp) {.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), .e = lhs.e + rhs.e + 64};
+}
+
+static inline __sp_diy_fp __sp_diy_fp_normalize(__sp_diy_fp x) {
+    const int shift = __builtin_clzll(x.f);
+    return (__sp_diy_fp) {.f = x.f << shift, .e = x.e - shift};
+}
+
+/* Normalized 10^-k with binary exponent such that the product with a value of exponent `e` lands in [-60, -32]. */
+static inline __sp_diy_fp __sp_grisu_cached_power(int e, int *k) {
+    static const uint64_t f[87] = {
+    0xfa8fd5a0081c0288, 0xbaaee17fa23ebf76, 0x8b16fb203055ac76, 0xcf42894a5dce35ea,
+    0x9a6bb0aa55653b2d, 0xe61acf033d1a45df, 0xab70fe17c79ac6ca, 0xff77b1fcbebcdc4f,
+    0xbe5691ef416bd60c, 0x8dd01fad907ffc3c, 0xd3515c2831559a83, 0x9d71ac8fada6c9b5,
+    0xea9c227723ee8bcb, 0xaecc49914078536d, 0x823c12795db6ce57, 0xc21094364dfb5637,
+    0x9096ea6f3848984f, 0xd77485cb25823ac7, 0xa086cfcd97bf97f4, 0xef340a98172aace5,
+    0xb23867fb2a35b28e, 0x84c8d4dfd2c63f3b, 0xc5dd44271ad3cdba, 0x936b9fcebb25c996,
+    0xdbac6c247d62a584, 0xa3ab66580d5fdaf6, 0xf3e2f893dec3f126, 0xb5b5ada8aaff80b8,
+    0x87625f056c7c4a8b, 0xc9bcff6034c13053, 0x964e858c91ba2655, 0xdff9772470297ebd,
+    0xa6dfbd9fb8e5b88f, 0xf8a95fcf88747d94, 0xb94470938fa89bcf, 0x8a08f0f8bf0f156b,
+    0xcdb02555653131b6, 0x993fe2c6d07b7fac, 0xe45c10c42a2b3b06, 0xaa242499697392d3,
+    0xfd87b5f28300ca0e, 0xbce5086492111aeb, 0x8cbccc096f5088cc, 0xd1b71758e219652c,
+    0x9c40000000000000, 0xe8d4a51000000000, 0xad78ebc5ac620000, 0x813f3978f8940984,
+    0xc097ce7bc90715b3, 0x8f7e32ce7bea5c70, 0xd5d238a4abe98068, 0x9f4f2726179a2245,
+    0xed63a231d4c4fb27, 0xb0de65388cc8ada8, 0x83c7088e1aab65db, 0xc45d1df942711d9a,
+    0x924d692ca61be758, 0xda01ee641a708dea, 0xa26da3999aef774a, 0xf209787bb47d6b85,
+    0xb454e4a179dd1877, 0x865b86925b9bc5c2, 0xc83553c5c8965d3d, 0x952ab45cfa97a0b3,
+    0xde469fbd99a05fe3, 0xa59bc234db398c25, 0xf6c69a72a3989f5c, 0xb7dcbf5354e9bece,
+    0x88fcf317f22241e2, 0xcc20ce9bd35c78a5, 0x98165af37b2153df, 0xe2a0b5dc971f303a,
+    0xa8d9d1535ce3b396, 0xfb9b7cd9a4a7443c, 0xbb764c4ca7a44410, 0x8bab8eefb6409c1a,
+    0xd01fef10a657842c, 0x9b10a4e5e9913129, 0xe7109bfba19c0c9d, 0xac2820d9623bf429,
+    0x80444b5e7aa7cf85, 0xbf21e44003acdd2d, 0x8e679c2f5e44ff8f, 0xd433179d9c8cb841,
+    0x9e19db92b4e31ba9, 0xeb96bf6ebadf77d9, 0xaf87023b9bf0ee6b,
+    };
+    static const int16_t exp[87] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+    -901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+    -582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+    -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+    56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+    694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+    1013, 1039, 1066,
+    };
+    const double dk = (-61 - e) * 0.30102999566398114 + 347; // 1 / log2(10)
+    int ik = (int) dk;
+    if (dk - ik > 0.0) {
+        ++ik;
+    }
+    const unsigned index = (unsigned) ((ik >> 3) + 1);
+    *k = -(-348 + (int) (index << 3));
+    return (__sp_diy_fp) {.f = f[index], .e = exp[index]};
+}
+
+static inline void __sp_grisu_round(char *buffer, int len, uint64_t delta, uint64_t rest, uint64_t ten_kappa,
+                                    uint64_t wp_w) {
+    while (rest < wp_w && delta - rest >= ten_kappa &&
+           (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+        buffer[len - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+static inline int __sp_grisu_digit_gen(__sp_diy_fp w, __sp_diy_fp mp, uint64_t delta, char *buffer, int *k) {
+    static const uint64_t pow10[20] = {
+        1ull,
+        10ull,
+        100ull,
+        1000ull,
+        10000ull,
+        100000ull,
+        1000000ull,
+        10000000ull,
+        100000000ull,
+        1000000000ull,
+        10000000000ull,
+        100000000000ull,
+        1000000000000ull,
+        10000000000000ull,
+        100000000000000ull,
+        1000000000000000ull,
+        10000000000000000ull,
+        100000000000000000ull,
+        1000000000000000000ull,
+        10000000000000000000ull,
+    };
+    const __sp_diy_fp one = {.f = (uint64_t) 1 << -mp.e, .e = mp.e};
+    const uint64_t wp_w = mp.f - w.f;
+    uint32_t p1 = (uint32_t) (mp.f >> -one.e);
+    uint64_t p2 = mp.f & (one.f - 1);
+    int kappa = (int) __sp_fmt_dec_digits(p1);
+    int len = 0;
+
+    while (kappa > 0) {
+        const uint32_t d = p1 / (uint32_t) pow10[kappa - 1];
+        p1 %= (uint32_t) pow10[kappa - 1];
+        if (d || len) {
+            buffer[len++] = (char) ('0' + d);
+        }
+        --kappa;
+        const uint64_t rest = ((uint64_t) p1 << -one.e) + p2;
+        if (rest <= delta) {
+            *k += kappa;
+            __sp_grisu_round(buffer, len, delta, rest, pow10[kappa] << -one.e, wp_w);
+            return len;
+        }
+    }
+
+    for (;;) {
+        p2 *= 10;
+        delta *= 10;
+        const char d = (char) (p2 >> -one.e);
+        if (d || len) {
+            buffer[len++] = (char) ('0' + d);
+        }
+        p2 &= one.f - 1;
+        --kappa;
+        if (p2 < delta) {
+            *k += kappa;
+            __sp_grisu_round(buffer, len, delta, p2, one.f, -kappa < 20 ? wp_w * pow10[-kappa] : 0);
+            return len;
+        }
+    }
+}
+
+/* Shortest digits of positive finite `value` into `buffer` (at least 17 bytes); `value = digits * 10^k`. */
+static inline int __sp_grisu2(double value, char *buffer, int *k) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    const int biased_e = (int) ((bits >> 52) & 0x7FF);
+    const uint64_t hidden = (uint64_t) 1 << 52;
+    __sp_diy_fp v = {.f = bits & (hidden - 1), .e = -1075 + 1};
+    if (biased_e != 0) {
+        v.f += hidden;
+        v.e = biased_e - 1075;
+    }
+
+    // Boundaries halfway to the neighbouring doubles; the lower gap is halved at powers of two.
+    __sp_diy_fp plus = __sp_diy_fp_normalize((__sp_diy_fp) {.f = (v.f << 1) + 1, .e = v.e - 1});
+    __sp_diy_fp minus = v.f == hidden ? (__sp_diy_fp) {.f = (v.f << 2) - 1, .e = v.e - 2}
+                                      : (__sp_diy_fp) {.f = (v.f << 1) - 1, .e = v.e - 1};
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+
+    const __sp_diy_fp c_mk = __sp_grisu_cached_power(plus.e, k);
+    const __sp_diy_fp w = __sp_diy_fp_mul(__sp_diy_fp_normalize(v), c_mk);
+    __sp_diy_fp wp = __sp_diy_fp_mul(plus, c_mk);
+    __sp_diy_fp wm = __sp_diy_fp_mul(minus, c_mk);
+    ++wm.f;
+    --wp.f;
+    return __sp_grisu_digit_gen(w, wp, wp.f - wm.f, buffer, k);
+}
+
+/*
+ * Appends a short round-trip representation of `value` (Grisu2; occasionally one digit longer than shortest), laid
+ * out like JavaScript's `Number.prototype.toString()` (`0.1`, `123`, `1e+21`, `1.5e-7`). Non-finite values print as
+ * `nan`, `inf`, `-inf`.
+ */
+static inline void sp_sb_append_double(Sp_String_Builder *sb, double value) {
+    __sp_sb_reserve_extra(sb, 32); // "-0.00000ddddddddddddddddd" at most
+    char *out = sb->data + sb->count;
+    char *const start = out;
+
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    if (bits >> 63) {
+        *out++ = '-';
+        value = -value;
+    }
+
+    if (value != value) {
+        out = start;
+        memcpy(out, "nan", 3);
+        out += 3;
+    } else if (value > 1.7976931348623157e308) {
+        memcpy(out, "inf", 3);
+        out += 3;
+    } else if (value == 0) {
+        *out++ = '0';
+    } else {
+        char digits[20];
+        int k;
+        const int len = __sp_grisu2(value, digits, &k);
+        const int point = len + k; // decimal point position relative to the first digit
+
+        if (len <= point && point <= 21) {
+            memcpy(out, digits, (size_t) len);
+            memset(out + len, '0', (size_t) (point - len));
+            out += point;
+        } else if (0 < point && point <= 21) {
+            memcpy(out, digits, (size_t) point);
+            out[point] = '.';
+            memcpy(out + point + 1, digits + point, (size_t) (len - point));
+            out += len + 1;
+        } else if (-6 < point && point <= 0) {
+            *out++ = '0';
+            *out++ = '.';
+            memset(out, '0', (size_t) -point);
+            out += -point;
+            memcpy(out, digits, (size_t) len);
+            out += len;
+        } else {
+            *out++ = digits[0];
+            if (len > 1) {
+                *out++ = '.';
+                memcpy(out, digits + 1, (size_t) (len - 1));
+                out += len - 1;
+            }
+            const int exp10 = point - 1;
+            *out++ = 'e';
+            *out++ = exp10 < 0 ? '-' : '+';
+            const unsigned magnitude = (unsigned) (exp10 < 0 ? -exp10 : exp10);
+            const unsigned exp_digits = __sp_fmt_dec_digits(magnitude);
+            __sp_fmt_write_dec(out + exp_digits, magnitude);
+            out += exp_digits;
+        }
+    }
+
+    sb->count += (size_t) (out - start);
+    sb->data[sb->count] = '\0';
+}
+
+/* `sp_da_shrink_to_fit()` for string builders, which keeps the null terminator past `count`. */
+static inline void sp_sb_shrink_to_fit(Sp_String_Builder *sb) {
+    if (sb->data) {
+        sp_da_alloc(sb, sb->count + 1);
+    }
 }
 
 static inline Sp_String_Builder sp_cstr_to_sb(const char *cstr) {
     Sp_String_Builder sb = {0};
-    sp_sb_appendf(&sb, "%s", cstr);
+    sp_sb_append_cstr(&sb, cstr);
     return sb;
 }
 
@@ -286,6 +939,10 @@ typedef struct {
     size_t count;
 } Sp_String_View;
 
+static inline void sp_sb_append_sv(Sp_String_Builder *sb, Sp_String_View sv) {
+    sp_sb_append_bytes(sb, sv.ptr, sv.count);
+}
+
 // TODO: C23 can make this macro static const, which turns this macro into a zero cost abstraction;
 // C11 forces this to be created as a stack variable at runtime, which incurs runtime overhead
 #define sp_cstr(literal) \
@@ -295,6 +952,8 @@ typedef struct {
 
 #define sp_cstr_slice(cstr) \
     (Sp_String_View) { .ptr = cstr, .count = strlen(cstr) }
+/* `sp_cstr_slice()` for string literals: the length is a compile-time `sizeof` instead of a `strlen()` call. */
+#define SP_SV_LIT(literal) ((Sp_String_View) {.ptr = "" literal, .count = sizeof(literal) - 1})
 
 static inline int sp_sv_cmp(const Sp_String_View *lhs, const Sp_String_View *rhs) {
     assert(lhs);
@@ -320,352 +979,2761 @@ static inline int sp_sv_cmp(const Sp_String_View *lhs, const Sp_String_View *rhs
 }
 
 static inline uint32_t sp_sv_eq(const Sp_String_View *lhs, const Sp_String_View *rhs) {
-    return !sp_sv_cmp(lhs, rhs);
+    assert(lhs);
+    assert(rhs);
+    return lhs->count == rhs->count && (lhs->count == 0 || !memcmp(lhs->ptr, rhs->ptr, lhs->count));
 }
 
-#define Sp_Queue(T)      \
-    struct {             \
-        T *data;         \
-        size_t count;    \
-        size_t head;     \
-        size_t tail;     \
-        size_t capacity; \
-    }
+/* Returned by the `sp_sv_find*()` family when there is no match. */
+#define SP_SV_NPOS ((size_t) -1)
 
-// TODO: update to use sp_da_alloc() backend or similar
-#define SP_QUEUE_INIT_CAP SP_DA_INIT_CAP
-#define sp_queue_reserve(queue, __expected__)                                                                      \
-    do {                                                                                                           \
-        const size_t expected = (__expected__);                                                                    \
-        size_t capacity = (queue)->capacity;                                                                       \
-        if (capacity < expected) {                                                                                 \
-            if (capacity == 0) {                                                                                   \
-                capacity = SP_QUEUE_INIT_CAP;                                                                      \
-            }                                                                                                      \
-            while (capacity < expected) {                                                                          \
-                capacity *= 2;                                                                                     \
-            }                                                                                                      \
-            __typeof__((queue)->data) data = (__typeof__((queue)->data)) calloc(capacity, sizeof(*(queue)->data)); \
-            assert(data);                                                                                          \
-            for (size_t i = 0; i < (queue)->capacity; ++i) {                                                       \
-                data[i] = (queue)->data[((queue)->head + i) % (queue)->capacity];                                  \
-            }                                                                                                      \
-            free((queue)->data);                                                                                   \
-            (queue)->data = data;                                                                                  \
-            (queue)->head = 0;                                                                                     \
-            (queue)->tail = (queue)->count;                                                                        \
-            (queue)->capacity = capacity;                                                                          \
-        }                                                                                                          \
-    } while (0)
+/* View of `sv[begin, end)`; both bounds are clamped to `sv->count`. */
+static inline Sp_String_View sp_sv_slice(const Sp_String_View *sv, size_t begin, size_t end) {
+    assert(sv);
+    if (end > sv->count) end = sv->count;
+    if (begin > end) begin = end;
+    return (Sp_String_View) {.ptr = sv->ptr + begin, .count = end - begin};
+}
 
-#define sp_queue_push(queue, element)                                                       \
-    do {                                                                                    \
-        sp_queue_reserve((queue), !(queue)->data ? SP_QUEUE_INIT_CAP : (queue)->count + 1); \
-        (queue)->data[(queue)->tail++ % (queue)->capacity] = (element);                     \
-        ++(queue)->count;                                                                   \
-    } while (0)
+static inline uint32_t sp_sv_starts_with(const Sp_String_View *sv, const Sp_String_View *prefix) {
+    assert(sv);
+    assert(prefix);
+    return sv->count >= prefix->count && (prefix->count == 0 || !memcmp(sv->ptr, prefix->ptr, prefix->count));
+}
 
-#define sp_queue_pop(queue)       \
-    do {                          \
-        if ((queue)->count > 0) { \
-            ++(queue)->head;      \
-            --(queue)->count;     \
-        }                         \
-    } while (0)
+static inline uint32_t sp_sv_ends_with(const Sp_String_View *sv, const Sp_String_View *suffix) {
+    assert(sv);
+    assert(suffix);
+    return sv->count >= suffix->count &&
+           (suffix->count == 0 || !memcmp(sv->ptr + sv->count - suffix->count, suffix->ptr, suffix->count));
+}
 
-#define sp_queue_peek(queue) ((queue)->count == 0 ? ((__typeof__(*(queue)->data)) {0}) : (queue)->data[(queue)->head % (queue)->capacity])
+/*
+ * Byte search works on blocks of `SP_SV_BLOCK` bytes at a time: `__sp_sv_block_match()` yields a mask with one lane
+ * set per byte equal to `c`, and lanes are `1 << SP_SV_MASK_SHIFT` bits wide (NEON narrows to nibbles).
+ */
+#if defined(__AVX2__)
+#define SP_SV_BLOCK 32
+#define SP_SV_MASK_SHIFT 0
+static inline uint64_t __sp_sv_block_match(const char *block, char c) {
+    const __m256i bytes = _mm256_loadu_si256((const __m256i *) (const void *) block);
+    return (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(c)));
+}
+#elif defined(__SSE2__)
+#define SP_SV_BLOCK 16
+#define SP_SV_MASK_SHIFT 0
+static inline uint64_t __sp_sv_block_match(const char *block, char c) {
+    const __m128i bytes = _mm_loadu_si128((const __m128i *) (const void *) block);
+    return (uint64_t) (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(c)));
+}
+#elif defined(__ARM_NEON)
+#define SP_SV_BLOCK 16
+#define SP_SV_MASK_SHIFT 2
+static inline uint64_t __sp_sv_block_match(const char *block, char c) {
+    const uint8x16_t eq = vceqq_u8(vld1q_u8((const uint8_t *) block), vdupq_n_u8((uint8_t) c));
+    const uint8x8_t narrowed = vshrn_n_u16(vreinterpretq_u16_u8(eq), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(narrowed), 0) & 0x8888888888888888ull;
+}
+#endif
 
-#define sp_queue_free(queue)                  \
-    do {                                      \
-        free((queue)->data);                  \
-        memset((queue), 0, sizeof(*(queue))); \
-    } while (0)
+#ifdef SP_SV_BLOCK
+#define __sp_sv_mask_lowest(mask) ((size_t) __builtin_ctzll(mask) >> SP_SV_MASK_SHIFT)
+#endif
 
-typedef struct sp_ll_node {
-    struct sp_ll_node *prev;
-    struct sp_ll_node *next;
-    char data[];
-} sp_ll_node;
+/*
+ * Index of the first `c` in `sv`, or `SP_SV_NPOS`. The first couple of blocks are scanned inline, which is where
+ * short fields (tokenizing) find their match; longer scans go to the libc `memchr`, which is vectorized and
+ * unrolled further than is worth doing here.
+ */
+static inline size_t sp_sv_find_char(const Sp_String_View *sv, char c) {
+    assert(sv);
+    size_t i = 0;
+#ifdef SP_SV_BLOCK
+    for (; i < 4 * SP_SV_BLOCK && i + SP_SV_BLOCK <= sv->count; i += SP_SV_BLOCK) {
+        const uint64_t mask = __sp_sv_block_match(sv->ptr + i, c);
+        if (mask) {
+            return i + __sp_sv_mask_lowest(mask);
+        }
+    }
+#endif
+    if (i < sv->count) {
+        const char *hit = memchr(sv->ptr + i, c, sv->count - i);
+        if (hit) {
+            return (size_t) (hit - sv->ptr);
+        }
+    }
+    return SP_SV_NPOS;
+}
 
-#define Sp_Linked_List(T) \
-    struct {              \
-        T type;           \
-        sp_ll_node *head; \
-        sp_ll_node *tail; \
+/*
+ * Index of the first occurrence of `needle` in `haystack` (0 for an empty needle), or `SP_SV_NPOS`.
+ *
+ * Candidates are filtered a block at a time by matching the needle's first and last bytes at their respective
+ * offsets, so only positions where both agree are compared in full.
+ */
+static inline size_t sp_sv_find(const Sp_String_View *haystack, const Sp_String_View *needle) {
+    assert(haystack);
+    assert(needle);
+    if (needle->count == 0) {
+        return 0;
+    }
+    if (needle->count > haystack->count) {
+        return SP_SV_NPOS;
+    }
+    if (needle->count == 1) {
+        return sp_sv_find_char(haystack, needle->ptr[0]);
     }
 
-/* Returns the type of the underlying data stored within the Sp_Linked_List. */
-#define sp_ll_type(ll) __typeof__((ll)->type)
-/* Returns a pointer of `sp_ll_type(ll)` to the underlying data stored at `sp_ll_node* node`. */
-#define sp_ll_node_unwrap(ll, node) ((sp_ll_type(ll) *) (node)->data)
+    const size_t last = needle->count - 1;
+    const size_t end = haystack->count - last; // candidate starts are [0, end)
+    size_t i = 0;
+#ifdef SP_SV_BLOCK
+    for (; i + SP_SV_BLOCK <= end; i += SP_SV_BLOCK) {
+        uint64_t mask = __sp_sv_block_match(haystack->ptr + i, needle->ptr[0]) &
+                        __sp_sv_block_match(haystack->ptr + i + last, needle->ptr[last]);
+        while (mask) {
+            const size_t candidate = i + __sp_sv_mask_lowest(mask);
+            if (!memcmp(haystack->ptr + candidate + 1, needle->ptr + 1, last - 1)) {
+                return candidate;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; i < end; ++i) {
+        const char *hit = memchr(haystack->ptr + i, needle->ptr[0], end - i);
+        if (!hit) {
+            break;
+        }
+        i = (size_t) (hit - haystack->ptr);
+        if (haystack->ptr[i + last] == needle->ptr[last] && !memcmp(hit + 1, needle->ptr + 1, last - 1)) {
+            return i;
+        }
+    }
+    return SP_SV_NPOS;
+}
 
-#define sp_ll_push_back(ll, element)                                                \
-    do {                                                                            \
-        if ((ll)->head == NULL && (ll)->tail == NULL) { /* uninitialized state */   \
-            (ll)->head = calloc(1, sizeof(*(ll)->head) + sizeof((ll)->type));       \
-            assert((ll)->head);                                                     \
-            *sp_ll_node_unwrap(ll, (ll)->head) = (element);                         \
-            (ll)->tail = (ll)->head;                                                \
-        } else {                                                                    \
-            (ll)->tail->next = calloc(1, sizeof(*(ll)->tail) + sizeof((ll)->type)); \
-            assert((ll)->tail->next);                                               \
-            (ll)->tail->next->prev = (ll)->tail;                                    \
-            (ll)->tail = (ll)->tail->next;                                          \
-            *sp_ll_node_unwrap(ll, (ll)->tail) = (element);                         \
-        }                                                                           \
-    } while (0)
-
-#define sp_ll_push_front(ll, element)                                               \
-    do {                                                                            \
-        if ((ll)->head == NULL && (ll)->tail == NULL) { /* uninitialized state */   \
-            (ll)->head = calloc(1, sizeof(*(ll)->head) + sizeof((ll)->type));       \
-            assert((ll)->head);                                                     \
-            *sp_ll_node_unwrap(ll, (ll)->head) = (element);                         \
-            (ll)->tail = (ll)->head;                                                \
-        } else {                                                                    \
-            (ll)->head->prev = calloc(1, sizeof(*(ll)->head) + sizeof((ll)->type)); \
-            assert((ll)->head->prev);                                               \
-            (ll)->head->prev->next = (ll)->head;                                    \
-            (ll)->head = (ll)->head->prev;                                          \
-            *sp_ll_node_unwrap(ll, (ll)->head) = (element);                         \
-        }                                                                           \
-    } while (0)
+/*
+ * Zero-allocation tokenizer: stores the next `delim`-separated field of `*rest` in `*token` and advances `*rest`
+ * past it. Fields may be empty ("a,,b" yields "a", "", "b"). Returns 0 once the input is exhausted.
+ *
+ *   Sp_String_View rest = input, field;
+ *   while (sp_sv_split_next(&rest, ',', &field)) { ... }
+ */
+static inline uint32_t sp_sv_split_next(Sp_String_View *rest, char delim, Sp_String_View *token) {
+    assert(rest);
+    assert(token);
+    if (!rest->ptr) {
+        return 0;
+    }
 
-// TODO: Make sp_ll_pop use a common backend for common functions
+    const size_t idx = sp_sv_find_char(rest, delim);
+    if (idx == SP_SV_NPOS) {
+        *token = *rest;
+        *rest = (Sp_String_View) {0};
+    } else {
+        *token = (Sp_String_View) {.ptr = rest->ptr, .count = idx};
+        rest->ptr += idx + 1;
+        rest->count -= idx + 1;
+    }
+    return 1;
+}
 
-#define sp_ll_pop_back(ll)                                                        \
-    do {                                                                          \
-        if ((ll)->head == NULL && (ll)->tail == NULL) { /* uninitialized state */ \
-            break;                                                                \
-        } else if ((ll)->head == (ll)->tail) { /* count == 1 */                   \
-            free((ll)->head);                                                     \
-            (ll)->head = NULL;                                                    \
-            (ll)->tail = NULL;                                                    \
-        } else {                                                                  \
-            (ll)->tail = (ll)->tail->prev;                                        \
-            free((ll)->tail->next);                                               \
-            (ll)->tail->next = NULL;                                              \
-        }                                                                         \
-    } while (0)
+static inline uint32_t __sp_sv_is_space(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
 
-#define sp_ll_pop_front(ll)                                                       \
-    do {                                                                          \
-        if ((ll)->head == NULL && (ll)->tail == NULL) { /* uninitialized state */ \
-            break;                                                                \
-        } else if ((ll)->head == (ll)->tail) { /* count == 1 */                   \
-            free((ll)->head);                                                     \
-            (ll)->head = NULL;                                                    \
+/* Drops leading ASCII whitespace. */
+static inline Sp_String_View sp_sv_trim_left(Sp_String_View sv) {
+    while (sv.count > 0 && __sp_sv_is_space(*sv.ptr)) {
+        ++sv.ptr;
+        --sv.count;
+    }
+    return sv;
+}
+
+/* Drops trailing ASCII whitespace. */
+static inline Sp_String_View sp_sv_trim_right(Sp_String_View sv) {
+    while (sv.count > 0 && __sp_sv_is_space(sv.ptr[sv.count - 1])) {
+        --sv.count;
+    }
+    return sv;
+}
+
+static inline Sp_String_View sp_sv_trim(Sp_String_View sv) { return sp_sv_trim_right(sp_sv_trim_left(sv)); }
+
+/* Drops one trailing '\r', so that "\r\n" line endings read like "\n". */
+static inline Sp_String_View __sp_sv_chomp_cr(Sp_String_View sv) {
+    if (sv.count > 0 && sv.ptr[sv.count - 1] == '\r') {
+        --sv.count;
+    }
+    return sv;
+}
+
+/*
+ * Line iterator: stores the next line of `*rest` (without its "\n" or "\r\n") in `*line` and advances `*rest` past
+ * it. A final line without a newline is still returned, but a trailing newline does not produce an empty line.
+ * Returns 0 once `*rest` is empty.
+ */
+static inline uint32_t sp_sv_next_line(Sp_String_View *rest, Sp_String_View *line) {
+    assert(rest);
+    assert(line);
+    if (rest->count == 0) {
+        return 0;
+    }
+
+    const size_t idx = sp_sv_find_char(rest, '\n');
+    const size_t count = idx == SP_SV_NPOS ? rest->count : idx;
+    *line = __sp_sv_chomp_cr((Sp_String_View) {.ptr = rest->ptr, .count = count});
+    const size_t consumed = idx == SP_SV_NPOS ? count : count + 1;
+    rest->ptr += consumed;
+    rest->count -= consumed;
+    return 1;
+}
+
+/*
+ * Streaming reader for inputs that cannot be mapped (pipes, sockets, stdin): reads `SP_FILE_CHUNK_SIZE` bytes at a
+ * time into a buffer that only ever holds the unconsumed tail, so memory stays bounded by the longest line.
+ * Zero-initialize and set `file`; the reader does not close it. A read error ends the stream like EOF, check
+ * `ferror(reader.file)` to tell them apart.
+ */
+#ifndef SP_FILE_CHUNK_SIZE
+#define SP_FILE_CHUNK_SIZE (64 * 1024)
+#endif
+
+typedef struct Sp_File_Reader {
+    FILE *file;
+    Sp_String_Builder buffer; // buffer.data[begin, buffer.count) is unconsumed
+    size_t begin;
+    uint32_t eof;
+} Sp_File_Reader;
+
+/* Reads the next chunk after the unconsumed bytes, moving those to the front first. Returns the bytes read. */
+static inline size_t sp_file_reader_fill(Sp_File_Reader *reader) {
+    assert(reader);
+    assert(reader->file);
+    if (reader->eof) {
+        return 0;
+    }
+
+    if (reader->begin > 0) {
+        memmove(reader->buffer.data, reader->buffer.data + reader->begin, reader->buffer.count - reader->begin);
+        reader->buffer.count -= reader->begin;
+        reader->begin = 0;
+    }
+    sp_da_reserve(&reader->buffer, reader->buffer.count + SP_FILE_CHUNK_SIZE);
+
+    const size_t got = fread(reader->buffer.data + reader->buffer.count, 1, SP_FILE_CHUNK_SIZE, reader->file);
+    reader->buffer.count += got;
+    if (got < SP_FILE_CHUNK_SIZE) {
+        reader->eof = 1;
+    }
+    return got;
+}
+
+/* Like `sp_sv_next_line()`, but over the stream. `*line` points into the reader and is valid until the next call. */
+static inline uint32_t sp_file_reader_next_line(Sp_File_Reader *reader, Sp_String_View *line) {
+    assert(reader);
+    assert(line);
+    size_t scanned = 0; // bytes of the unconsumed tail already known to hold no newline
+    for (;;) {
+        const Sp_String_View unread = {
+            .ptr = reader->buffer.data + reader->begin + scanned,
+            .count = reader->buffer.count - reader->begin - scanned,
+        };
+        const size_t idx = unread.count ? sp_sv_find_char(&unread, '\n') : SP_SV_NPOS;
+        if (idx != SP_SV_NPOS) {
+            const char *start = reader->buffer.data + reader->begin;
+            *line = __sp_sv_chomp_cr((Sp_String_View) {.ptr = start, .count = scanned + idx});
+            reader->begin += scanned + idx + 1;
+            return 1;
+        }
+        scanned += unread.count;
+
+        if (reader->eof) {
+            if (scanned == 0) {
+                return 0;
+            }
+            *line = __sp_sv_chomp_cr((Sp_String_View) {.ptr = reader->buffer.data + reader->begin, .count = scanned});
+            reader->begin += scanned;
+            return 1;
+        }
+        sp_file_reader_fill(reader);
+    }
+}
+
+static inline void sp_file_reader_free(Sp_File_Reader *reader) {
+    sp_da_free(&reader->buffer);
+    reader->begin = 0;
+    reader->eof = 0;
+}
+
+/*
+ * Read-only view of a whole file. Regular files are memory-mapped, so `view` aliases the page cache and nothing is
+ * copied; anything else (pipes, character devices, platforms without mmap or with `SP_NO_MMAP`) is read into
+ * `buffer` instead.
+ */
+typedef struct Sp_File_Map {
+    Sp_String_View view;
+    void *mapping;
+    size_t mapping_size;
+    Sp_String_Builder buffer;
+} Sp_File_Map;
+
+/* Access pattern hints for `sp_file_map_open()`, passed on to the kernel where supported. */
+typedef enum {
+    SP_FILE_MAP_SEQUENTIAL = 1 << 0, // aggressive read-ahead, pages can be dropped behind the reader
+    SP_FILE_MAP_WILLNEED = 1 << 1,   // start paging the whole file in right away
+} Sp_File_Map_Hint;
+
+/*
+ * Maps `path` into `map->view`. Returns 0 on success, -1 with `errno` set on failure.
+ *
+ * The hints need `posix_madvise()`, which strict ISO modes (e.g. `-std=c11`) only declare when `_POSIX_C_SOURCE` is
+ * defined to 200112L or later before any system header is included; without it they are ignored.
+ */
+static inline int sp_file_map_open(Sp_File_Map *map, const char *path, unsigned hints) {
+    assert(map);
+    assert(path);
+    (void) hints; // unused without posix_madvise()
+    map->view = (Sp_String_View) {0};
+    map->mapping = NULL;
+    map->mapping_size = 0;
+    map->buffer.count = 0;
+
+#ifdef SP_HAS_MMAP
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        const int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *mapping = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            close(fd);
+#ifdef POSIX_MADV_SEQUENTIAL
+            if (hints & SP_FILE_MAP_SEQUENTIAL) posix_madvise(mapping, (size_t) st.st_size, POSIX_MADV_SEQUENTIAL);
+            if (hints & SP_FILE_MAP_WILLNEED) posix_madvise(mapping, (size_t) st.st_size, POSIX_MADV_WILLNEED);
+#endif
+            map->mapping = mapping;
+            map->mapping_size = (size_t) st.st_size;
+            map->view = (Sp_String_View) {.ptr = mapping, .count = (size_t) st.st_size};
+            return 0;
+        }
+    }
+
+    // Not mappable: read it all through the descriptor we already have (reopening a FIFO would lose its writer).
+    for (;;) {
+        sp_da_reserve(&map->buffer, map->buffer.count + SP_FILE_CHUNK_SIZE);
+        const ssize_t got = read(fd, map->buffer.data + map->buffer.count, SP_FILE_CHUNK_SIZE);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got < 0) {
+            const int err = errno;
+            close(fd);
+            errno = err;
+            return -1;
+        }
+        if (got == 0) {
+            break;
+        }
+        map->buffer.count += (size_t) got;
+    }
+    close(fd);
+#else
+    Sp_File_Reader reader = {.file = fopen(path, "rb")};
+    if (!reader.file) {
+        return -1;
+    }
+    reader.buffer = map->buffer;
+    while (sp_file_reader_fill(&reader) > 0) {
+    }
+    map->buffer = reader.buffer;
+    if (ferror(reader.file)) {
+        fclose(reader.file);
+        errno = EIO;
+        return -1;
+    }
+    fclose(reader.file);
+#endif
+
+    map->view = (Sp_String_View) {.ptr = map->buffer.data, .count = map->buffer.count};
+    return 0;
+}
+
+static inline void sp_file_map_close(Sp_File_Map *map) {
+#ifdef SP_HAS_MMAP
+    if (map->mapping) {
+        munmap(map->mapping, map->mapping_size);
+    }
+#endif
+    sp_da_free(&map->buffer);
+    map->view = (Sp_String_View) {0};
+    map->mapping = NULL;
+    map->mapping_size = 0;
+}
+
+#define Sp_Queue(T)                    \
+    struct {                           \
+        T *data;                       \
+        size_t count;                  \
+        size_t head;                   \
+        size_t tail;                   \
+        size_t capacity;               \
+        const Sp_Allocator *allocator; \
+    }
+
+/*
+ * The capacity of an `Sp_Queue` is always a power of two (`SP_QUEUE_INIT_CAP` doubled as needed), so the ever
+ * increasing `head`/`tail` counters are mapped onto slots with a mask instead of a division.
+ */
+#define SP_QUEUE_INIT_CAP SP_DA_INIT_CAP
+#define sp_queue_slot(queue, idx) ((idx) & ((queue)->capacity - 1))
+_Static_assert((SP_QUEUE_INIT_CAP & (SP_QUEUE_INIT_CAP - 1)) == 0, "SP_QUEUE_INIT_CAP must be a power of two");
+/* Grows by reallocating in place when possible: the elements that wrapped around to the front of the old slot array
+ * are then moved right after it, so the contents stay contiguous from the same head slot. */
+#define sp_queue_reserve(queue, __expected__)                                                                    \
+    do {                                                                                                         \
+        const size_t expected = (__expected__);                                                                  \
+        size_t capacity = (queue)->capacity;                                                                     \
+        if (capacity < expected) {                                                                               \
+            if (capacity == 0) {                                                                                 \
+                capacity = SP_QUEUE_INIT_CAP;                                                                    \
+            }                                                                                                    \
+            while (capacity < expected) {                                                                        \
+                capacity *= 2;                                                                                   \
+            }                                                                                                    \
+            const size_t old_capacity = (queue)->capacity;                                                       \
+            const size_t head_slot = old_capacity ? sp_queue_slot((queue), (queue)->head) : 0;                   \
+            const size_t wrapped =                                                                               \
+                head_slot + (queue)->count > old_capacity ? head_slot + (queue)->count - old_capacity : 0;       \
+            (queue)->data = sp_realloc((queue)->allocator, (queue)->data, old_capacity * sizeof(*(queue)->data), \
+                                       capacity * sizeof(*(queue)->data));                                       \
+            memcpy((queue)->data + old_capacity, (queue)->data, wrapped * sizeof(*(queue)->data));               \
+            (queue)->head = head_slot;                                                                           \
+            (queue)->tail = head_slot + (queue)->count;                                                          \
+            (queue)->capacity = capacity;                                                                        \
+        }                                                                                                        \
+    } while (0)
+
+#define sp_queue_push(queue, element)                                                       \
+    do {                                                                                    \
+        sp_queue_reserve((queue), !(queue)->data ? SP_QUEUE_INIT_CAP : (queue)->count + 1); \
+        (queue)->data[sp_queue_slot((queue), (queue)->tail++)] = (element);                 \
+        ++(queue)->count;                                                                   \
+    } while (0)
+
+#define sp_queue_pop(queue)       \
+    do {                          \
+        if ((queue)->count > 0) { \
+            ++(queue)->head;      \
+            --(queue)->count;     \
+        }                         \
+    } while (0)
+
+#define sp_queue_peek(queue) ((queue)->count == 0 ? ((__typeof__(*(queue)->data)) {0}) : (queue)->data[sp_queue_slot((queue), (queue)->head)])
+
+/*
+ * Zero-copy access: the readable elements, or `n` writable slots, as at most two contiguous spans. Fill in
+ * `spans.data[0][0, spans.count[0])` then `spans.data[1][0, spans.count[1])`, e.g. straight from `read()`, and
+ * publish them with `sp_queue_commit()`; read spans in the same order and release them with `sp_queue_consume()`.
+ */
+#define Sp_Queue_Spans(T) \
+    struct {              \
+        T *data[2];       \
+        size_t count[2];  \
+    }
+
+#define __sp_queue_spans(queue, first, n, spans_ptr)                                                             \
+    do {                                                                                                         \
+        const size_t macro_var(spn_slot) = (queue)->capacity ? sp_queue_slot((queue), (first)) : 0;              \
+        const size_t macro_var(spn_n) = (n);                                                                     \
+        const size_t macro_var(spn_room) = (queue)->capacity - macro_var(spn_slot);                              \
+        (spans_ptr)->data[0] = (queue)->data + macro_var(spn_slot);                                              \
+        (spans_ptr)->count[0] = macro_var(spn_n) < macro_var(spn_room) ? macro_var(spn_n) : macro_var(spn_room); \
+        (spans_ptr)->data[1] = (queue)->data;                                                                    \
+        (spans_ptr)->count[1] = macro_var(spn_n) - (spans_ptr)->count[0];                                        \
+    } while (0)
+
+#define sp_queue_read_spans(queue, spans_ptr) __sp_queue_spans((queue), (queue)->head, (queue)->count, (spans_ptr))
+
+/* Releases the `n` oldest elements. */
+#define sp_queue_consume(queue, n)                 \
+    do {                                           \
+        const size_t macro_var(qc_n) = (n);        \
+        assert(macro_var(qc_n) <= (queue)->count); \
+        (queue)->head += macro_var(qc_n);          \
+        (queue)->count -= macro_var(qc_n);         \
+    } while (0)
+
+/* Makes room for `n` more elements and points `spans_ptr` at their slots; nothing is pushed until committed. */
+#define sp_queue_write_spans(queue, n, spans_ptr)                               \
+    do {                                                                        \
+        const size_t macro_var(qw_n) = (n);                                     \
+        sp_queue_reserve((queue), (queue)->count + macro_var(qw_n));            \
+        __sp_queue_spans((queue), (queue)->tail, macro_var(qw_n), (spans_ptr)); \
+    } while (0)
+
+/* Pushes the first `n` slots handed out by `sp_queue_write_spans()`. */
+#define sp_queue_commit(queue, n)                                       \
+    do {                                                                \
+        const size_t macro_var(qcm_n) = (n);                            \
+        assert((queue)->count + macro_var(qcm_n) <= (queue)->capacity); \
+        (queue)->tail += macro_var(qcm_n);                              \
+        (queue)->count += macro_var(qcm_n);                             \
+    } while (0)
+
+/* Pushes `items[0, n)` with at most two copies. */
+#define sp_queue_push_n(queue, items, n)                                                                           \
+    do {                                                                                                           \
+        const size_t macro_var(qpn_n) = (n);                                                                       \
+        if (macro_var(qpn_n) > 0) {                                                                                \
+            Sp_Queue_Spans(__typeof__(*(queue)->data)) macro_var(qpn_spans);                                       \
+            sp_queue_write_spans((queue), macro_var(qpn_n), &macro_var(qpn_spans));                                \
+            memcpy(macro_var(qpn_spans).data[0], (items), macro_var(qpn_spans).count[0] * sizeof(*(queue)->data)); \
+            memcpy(macro_var(qpn_spans).data[1], (items) + macro_var(qpn_spans).count[0],                          \
+                   macro_var(qpn_spans).count[1] * sizeof(*(queue)->data));                                        \
+            sp_queue_commit((queue), macro_var(qpn_n));                                                            \
+        }                                                                                                          \
+    } while (0)
+
+/* Pops up to `n` of the oldest elements into `out`, storing how many in `*popped_ptr`. To drop elements without
+ * copying them, use `sp_queue_consume()`. */
+#define sp_queue_pop_n(queue, out, n, popped_ptr)                                                                \
+    do {                                                                                                         \
+        size_t macro_var(qpp_n) = (n);                                                                           \
+        if (macro_var(qpp_n) > (queue)->count) {                                                                 \
+            macro_var(qpp_n) = (queue)->count;                                                                   \
+        }                                                                                                        \
+        if (macro_var(qpp_n) > 0) {                                                                              \
+            Sp_Queue_Spans(__typeof__(*(queue)->data)) macro_var(qpp_spans);                                     \
+            __sp_queue_spans((queue), (queue)->head, macro_var(qpp_n), &macro_var(qpp_spans));                   \
+            memcpy((out), macro_var(qpp_spans).data[0], macro_var(qpp_spans).count[0] * sizeof(*(queue)->data)); \
+            memcpy((out) + macro_var(qpp_spans).count[0], macro_var(qpp_spans).data[1],                          \
+                   macro_var(qpp_spans).count[1] * sizeof(*(queue)->data));                                      \
+            sp_queue_consume((queue), macro_var(qpp_n));                                                         \
+        }                                                                                                        \
+        *(popped_ptr) = macro_var(qpp_n);                                                                        \
+    } while (0)
+
+#define sp_queue_free(queue)                                                                            \
+    do {                                                                                                \
+        const Sp_Allocator *macro_var(queue_allocator) = (queue)->allocator;                            \
+        sp_free(macro_var(queue_allocator), (queue)->data, (queue)->capacity * sizeof(*(queue)->data)); \
+        memset((queue), 0, sizeof(*(queue)));                                                           \
+        (queue)->allocator = macro_var(queue_allocator);                                                \
+    } while (0)
+
+#ifdef SP_HAS_ATOMICS
+/*
+ * Bounded lock-free rings for handing elements between threads, the concurrent counterparts of `Sp_Queue`:
+ *  - `Sp_Spsc_Ring(T)`: exactly one producer thread and one consumer thread. Each side owns its cursor and keeps
+ *    a cached copy of the other's, so it only touches the shared cache line when the cache says full or empty.
+ *  - `Sp_Mpmc_Ring(T)`: any number of producers and consumers (Vyukov's bounded queue). Every slot carries a
+ *    sequence number saying whose turn it is; a thread claims positions with one CAS on the shared cursor.
+ * The cursors sit on separate cache lines so producers and consumers do not false-share; place rings in static
+ * or `SP_CACHE_LINE`-aligned storage. Capacity is fixed at init (rounded up to a power of two) and a full ring
+ * refuses pushes instead of growing. Batch operations move up to `n` elements for a single cursor update and
+ * report how many they moved, which may be fewer; single-element forms report 1 or 0.
+ *
+ *     Sp_Spsc_Ring(Job) ring = {0};
+ *     sp_spsc_ring_init(&ring, 1024);
+ *     size_t pushed;
+ *     sp_spsc_ring_push_n(&ring, jobs, count, &pushed); // producer thread
+ *     size_t popped;
+ *     sp_spsc_ring_pop_n(&ring, out, 64, &popped);      // consumer thread
+ *
+ * Elements are copied by assignment. Init and free must not race with other operations.
+ */
+static inline size_t __sp_ring_capacity(size_t requested, size_t minimum) {
+    size_t capacity = minimum;
+    while (capacity < requested) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+typedef struct {
+    _Alignas(SP_CACHE_LINE) _Atomic size_t head; // next position to pop, written by the consumer
+    size_t tail_cache;                           // consumer's last view of `tail`
+    _Alignas(SP_CACHE_LINE) _Atomic size_t tail; // next position to push, written by the producer
+    size_t head_cache;                           // producer's last view of `head`
+    _Alignas(SP_CACHE_LINE) size_t capacity;
+} Sp_Spsc_Cursors;
+
+#define Sp_Spsc_Ring(T)                \
+    struct {                           \
+        Sp_Spsc_Cursors cursors;       \
+        T *data;                       \
+        const Sp_Allocator *allocator; \
+    }
+
+/* Producer side: up to `n` free positions starting at `*first`. */
+static inline size_t __sp_spsc_claim_push(Sp_Spsc_Cursors *c, size_t n, size_t *first) {
+    const size_t tail = atomic_load_explicit(&c->tail, memory_order_relaxed);
+    size_t space = c->capacity - (tail - c->head_cache);
+    if (space < n) {
+        c->head_cache = atomic_load_explicit(&c->head, memory_order_acquire);
+        space = c->capacity - (tail - c->head_cache);
+    }
+    *first = tail;
+    return n < space ? n : space;
+}
+
+/* Consumer side: up to `n` filled positions starting at `*first`. */
+static inline size_t __sp_spsc_claim_pop(Sp_Spsc_Cursors *c, size_t n, size_t *first) {
+    const size_t head = atomic_load_explicit(&c->head, memory_order_relaxed);
+    size_t ready = c->tail_cache - head;
+    if (ready < n) {
+        c->tail_cache = atomic_load_explicit(&c->tail, memory_order_acquire);
+        ready = c->tail_cache - head;
+    }
+    *first = head;
+    return n < ready ? n : ready;
+}
+
+#define sp_spsc_ring_init(ring, __capacity__)                                                         \
+    do {                                                                                              \
+        const size_t macro_var(spsc_capacity) = __sp_ring_capacity((__capacity__), 1);                \
+        (ring)->data = sp_alloc((ring)->allocator, macro_var(spsc_capacity) * sizeof(*(ring)->data)); \
+        atomic_init(&(ring)->cursors.head, 0);                                                        \
+        atomic_init(&(ring)->cursors.tail, 0);                                                        \
+        (ring)->cursors.head_cache = (ring)->cursors.tail_cache = 0;                                  \
+        (ring)->cursors.capacity = macro_var(spsc_capacity);                                          \
+    } while (0)
+
+#define sp_spsc_ring_push_n(ring, items, n, pushed_ptr)                                                                \
+    do {                                                                                                               \
+        size_t macro_var(spsc_first);                                                                                  \
+        const size_t macro_var(spsc_n) = __sp_spsc_claim_push(&(ring)->cursors, (n), &macro_var(spsc_first));          \
+        for (size_t macro_var(spsc_i) = 0; macro_var(spsc_i) < macro_var(spsc_n); ++macro_var(spsc_i)) {               \
+            (ring)->data[(macro_var(spsc_first) + macro_var(spsc_i)) & ((ring)->cursors.capacity - 1)] =               \
+                (items)[macro_var(spsc_i)];                                                                            \
+        }                                                                                                              \
+        atomic_store_explicit(&(ring)->cursors.tail, macro_var(spsc_first) + macro_var(spsc_n), memory_order_release); \
+        *(pushed_ptr) = macro_var(spsc_n);                                                                             \
+    } while (0)
+
+#define sp_spsc_ring_pop_n(ring, out, n, popped_ptr)                                                                   \
+    do {                                                                                                               \
+        size_t macro_var(spsc_first);                                                                                  \
+        const size_t macro_var(spsc_n) = __sp_spsc_claim_pop(&(ring)->cursors, (n), &macro_var(spsc_first));           \
+        for (size_t macro_var(spsc_i) = 0; macro_var(spsc_i) < macro_var(spsc_n); ++macro_var(spsc_i)) {               \
+            (out)[macro_var(spsc_i)] =                                                                                 \
+                (ring)->data[(macro_var(spsc_first) + macro_var(spsc_i)) & ((ring)->cursors.capacity - 1)];            \
+        }                                                                                                              \
+        atomic_store_explicit(&(ring)->cursors.head, macro_var(spsc_first) + macro_var(spsc_n), memory_order_release); \
+        *(popped_ptr) = macro_var(spsc_n);                                                                             \
+    } while (0)
+
+#define sp_spsc_ring_push(ring, element, pushed_ptr)                            \
+    do {                                                                        \
+        const __typeof__(*(ring)->data) macro_var(spsc_element) = (element);    \
+        sp_spsc_ring_push_n((ring), &macro_var(spsc_element), 1, (pushed_ptr)); \
+    } while (0)
+
+#define sp_spsc_ring_pop(ring, out_ptr, popped_ptr) sp_spsc_ring_pop_n((ring), (out_ptr), 1, (popped_ptr))
+
+#define sp_spsc_ring_free(ring)                                                                     \
+    do {                                                                                            \
+        sp_free((ring)->allocator, (ring)->data, (ring)->cursors.capacity * sizeof(*(ring)->data)); \
+        (ring)->data = NULL;                                                                        \
+        (ring)->cursors.capacity = 0;                                                               \
+    } while (0)
+
+typedef struct {
+    _Alignas(SP_CACHE_LINE) _Atomic size_t enqueue; // next position to push
+    _Alignas(SP_CACHE_LINE) _Atomic size_t dequeue; // next position to pop
+    _Alignas(SP_CACHE_LINE) size_t capacity;
+} Sp_Mpmc_Cursors;
+
+/* A slot is free for position `pos` when its `seq` is `pos`, and holds the element pushed at `pos` once `seq` is
+ * `pos + 1`; popping hands it to position `pos + capacity`. */
+#define Sp_Mpmc_Ring(T)                \
+    struct {                           \
+        Sp_Mpmc_Cursors cursors;       \
+        struct {                       \
+            _Atomic size_t seq;        \
+            T value;                   \
+        } *slots;                      \
+        const Sp_Allocator *allocator; \
+    }
+
+static inline _Atomic size_t *__sp_mpmc_seq(void *slots, size_t stride, size_t capacity, size_t pos) {
+    return (_Atomic size_t *) (void *) ((unsigned char *) slots + (pos & (capacity - 1)) * stride);
+}
+
+/*
+ * Claims up to `n` consecutive positions of `*cursor` whose slots have `seq == pos + lag` (lag 0 to push, 1 to
+ * pop) with a single CAS, storing the first in `*first`. Returns 0 when the ring is full (push) or empty (pop).
+ */
+static inline size_t __sp_mpmc_claim(_Atomic size_t *cursor, void *slots, size_t stride, size_t capacity, size_t n,
+                                     size_t lag, size_t *first) {
+    if (n == 0) {
+        return 0;
+    }
+    size_t pos = atomic_load_explicit(cursor, memory_order_relaxed);
+    for (;;) {
+        size_t k = 0;
+        intptr_t diff = 0;
+        for (; k < n; ++k) {
+            const size_t seq =
+                atomic_load_explicit(__sp_mpmc_seq(slots, stride, capacity, pos + k), memory_order_acquire);
+            diff = (intptr_t) (seq - (pos + k + lag));
+            if (diff != 0) {
+                break;
+            }
+        }
+        if (k > 0) {
+            // On failure `pos` is reloaded with the cursor's current value
+            if (atomic_compare_exchange_weak_explicit(cursor, &pos, pos + k, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                *first = pos;
+                return k;
+            }
+        } else if (diff < 0) {
+            return 0;
+        } else {
+            // Another thread claimed `pos` in the meantime
+            pos = atomic_load_explicit(cursor, memory_order_relaxed);
+        }
+    }
+}
+
+/* Hands the `n` slots from position `first` on to position `pos + bump` (1 after a push, capacity after a pop). */
+static inline void __sp_mpmc_release(void *slots, size_t stride, size_t capacity, size_t first, size_t n,
+                                     size_t bump) {
+    for (size_t i = 0; i < n; ++i) {
+        atomic_store_explicit(__sp_mpmc_seq(slots, stride, capacity, first + i), first + i + bump,
+                              memory_order_release);
+    }
+}
+
+#define sp_mpmc_ring_init(ring, __capacity__)                                                                   \
+    do {                                                                                                        \
+        const size_t macro_var(mpmc_capacity) = __sp_ring_capacity((__capacity__), 2);                          \
+        (ring)->slots = sp_alloc((ring)->allocator, macro_var(mpmc_capacity) * sizeof(*(ring)->slots));         \
+        for (size_t macro_var(mpmc_i) = 0; macro_var(mpmc_i) < macro_var(mpmc_capacity); ++macro_var(mpmc_i)) { \
+            atomic_init(&(ring)->slots[macro_var(mpmc_i)].seq, macro_var(mpmc_i));                              \
+        }                                                                                                       \
+        atomic_init(&(ring)->cursors.enqueue, 0);                                                               \
+        atomic_init(&(ring)->cursors.dequeue, 0);                                                               \
+        (ring)->cursors.capacity = macro_var(mpmc_capacity);                                                    \
+    } while (0)
+
+#define sp_mpmc_ring_push_n(ring, items, n, pushed_ptr)                                                           \
+    do {                                                                                                          \
+        const size_t macro_var(mpmc_capacity) = (ring)->cursors.capacity;                                         \
+        size_t macro_var(mpmc_first);                                                                             \
+        const size_t macro_var(mpmc_n) =                                                                          \
+            __sp_mpmc_claim(&(ring)->cursors.enqueue, (ring)->slots, sizeof(*(ring)->slots),                      \
+                            macro_var(mpmc_capacity), (n), 0, &macro_var(mpmc_first));                            \
+        for (size_t macro_var(mpmc_i) = 0; macro_var(mpmc_i) < macro_var(mpmc_n); ++macro_var(mpmc_i)) {          \
+            (ring)->slots[(macro_var(mpmc_first) + macro_var(mpmc_i)) & (macro_var(mpmc_capacity) - 1)].value =   \
+                (items)[macro_var(mpmc_i)];                                                                       \
+        }                                                                                                         \
+        __sp_mpmc_release((ring)->slots, sizeof(*(ring)->slots), macro_var(mpmc_capacity), macro_var(mpmc_first), \
+                          macro_var(mpmc_n), 1);                                                                  \
+        *(pushed_ptr) = macro_var(mpmc_n);                                                                        \
+    } while (0)
+
+#define sp_mpmc_ring_pop_n(ring, out, n, popped_ptr)                                                               \
+    do {                                                                                                           \
+        const size_t macro_var(mpmc_capacity) = (ring)->cursors.capacity;                                          \
+        size_t macro_var(mpmc_first);                                                                              \
+        const size_t macro_var(mpmc_n) =                                                                           \
+            __sp_mpmc_claim(&(ring)->cursors.dequeue, (ring)->slots, sizeof(*(ring)->slots),                       \
+                            macro_var(mpmc_capacity), (n), 1, &macro_var(mpmc_first));                             \
+        for (size_t macro_var(mpmc_i) = 0; macro_var(mpmc_i) < macro_var(mpmc_n); ++macro_var(mpmc_i)) {           \
+            (out)[macro_var(mpmc_i)] =                                                                             \
+                (ring)->slots[(macro_var(mpmc_first) + macro_var(mpmc_i)) & (macro_var(mpmc_capacity) - 1)].value; \
+        }                                                                                                          \
+        __sp_mpmc_release((ring)->slots, sizeof(*(ring)->slots), macro_var(mpmc_capacity), macro_var(mpmc_first),  \
+                          macro_var(mpmc_n), macro_var(mpmc_capacity));                                            \
+        *(popped_ptr) = macro_var(mpmc_n);                                                                         \
+    } while (0)
+
+#define sp_mpmc_ring_push(ring, element, pushed_ptr)                                \
+    do {                                                                            \
+        const __typeof__((ring)->slots->value) macro_var(mpmc_element) = (element); \
+        sp_mpmc_ring_push_n((ring), &macro_var(mpmc_element), 1, (pushed_ptr));     \
+    } while (0)
+
+#define sp_mpmc_ring_pop(ring, out_ptr, popped_ptr) sp_mpmc_ring_pop_n((ring), (out_ptr), 1, (popped_ptr))
+
+#define sp_mpmc_ring_free(ring)                                                                       \
+    do {                                                                                              \
+        sp_free((ring)->allocator, (ring)->slots, (ring)->cursors.capacity * sizeof(*(ring)->slots)); \
+        (ring)->slots = NULL;                                                                         \
+        (ring)->cursors.capacity = 0;                                                                 \
+    } while (0)
+#endif
+
+/*
+ * Fixed-size node allocator: nodes are carved out of geometrically growing slabs and recycled through an intrusive
+ * free list, so steady-state push/pop never reaches the allocator. Memory only goes back on `sp_node_pool_free()`.
+ * Zero-initialize before use; a pool can be shared by containers whose nodes have the same size.
+ */
+#ifndef SP_NODE_POOL_INIT_SLAB
+#define SP_NODE_POOL_INIT_SLAB 32
+#endif
+#ifndef SP_NODE_POOL_MAX_SLAB
+#define SP_NODE_POOL_MAX_SLAB 4096
+#endif
+
+typedef struct Sp_Node_Pool_Slab {
+    struct Sp_Node_Pool_Slab *next;
+    size_t bytes;
+    _Alignas(max_align_t) unsigned char data[];
+} Sp_Node_Pool_Slab;
+
+typedef struct Sp_Node_Pool {
+    void *free_list;
+    Sp_Node_Pool_Slab *slabs;
+    unsigned char *cursor; // unused tail of the newest slab
+    unsigned char *end;
+    size_t node_size; // stride, fixed by the first allocation
+    size_t slab_nodes;
+    const Sp_Allocator *allocator;
+} Sp_Node_Pool;
+
+/* Returns an uninitialized node of `node_size` bytes aligned to `align` (at most `SP_ARENA_ALIGN`). */
+static inline void *sp_node_pool_alloc(Sp_Node_Pool *pool, size_t node_size, size_t align) {
+    assert(align <= SP_ARENA_ALIGN);
+    node_size = (node_size + align - 1) & ~(align - 1);
+    if (node_size < sizeof(void *)) {
+        node_size = sizeof(void *);
+    }
+    assert(pool->node_size == 0 || pool->node_size == node_size);
+    pool->node_size = node_size;
+
+    if (pool->free_list) {
+        void *node = pool->free_list;
+        memcpy(&pool->free_list, node, sizeof(void *));
+        return node;
+    }
+
+    if (pool->cursor == pool->end) {
+        pool->slab_nodes = pool->slab_nodes ? pool->slab_nodes * 2 : SP_NODE_POOL_INIT_SLAB;
+        if (pool->slab_nodes > SP_NODE_POOL_MAX_SLAB) {
+            pool->slab_nodes = SP_NODE_POOL_MAX_SLAB;
+        }
+        const size_t bytes = sizeof(Sp_Node_Pool_Slab) + pool->slab_nodes * node_size;
+        Sp_Node_Pool_Slab *slab = sp_alloc(pool->allocator, bytes);
+        slab->bytes = bytes;
+        slab->next = pool->slabs;
+        pool->slabs = slab;
+        pool->cursor = slab->data;
+        pool->end = slab->data + pool->slab_nodes * node_size;
+    }
+
+    void *node = pool->cursor;
+    pool->cursor += node_size;
+    return node;
+}
+
+/* Hands `node` back to the pool for reuse. */
+static inline void sp_node_pool_release(Sp_Node_Pool *pool, void *node) {
+    memcpy(node, &pool->free_list, sizeof(void *));
+    pool->free_list = node;
+}
+
+/* Returns every slab to the allocator, invalidating all nodes handed out by the pool. */
+static inline void sp_node_pool_free(Sp_Node_Pool *pool) {
+    Sp_Node_Pool_Slab *slab = pool->slabs;
+    while (slab) {
+        Sp_Node_Pool_Slab *next = slab->next;
+        sp_free(pool->allocator, slab, slab->bytes);
+        slab = next;
+    }
+    const Sp_Allocator *allocator = pool->allocator;
+    memset(pool, 0, sizeof(*pool));
+    pool->allocator = allocator;
+}
+
+typedef struct sp_ll_node {
+    struct sp_ll_node *prev;
+    struct sp_ll_node *next;
+    char data[];
+} sp_ll_node;
+
+/*
+ * Doubly linked list. Nodes come from the list's own node pool, or from `pool` when it is set (e.g. to share one
+ * pool across many short lists of the same element type).
+ */
+#define Sp_Linked_List(T)              \
+    struct {                           \
+        T type;                        \
+        sp_ll_node *head;              \
+        sp_ll_node *tail;              \
+        const Sp_Allocator *allocator; \
+        Sp_Node_Pool *pool;            \
+        Sp_Node_Pool nodes;            \
+    }
+
+/* Returns the type of the underlying data stored within the Sp_Linked_List. */
+#define sp_ll_type(ll) __typeof__((ll)->type)
+/* Returns a pointer of `sp_ll_type(ll)` to the underlying data stored at `sp_ll_node* node`. */
+#define sp_ll_node_unwrap(ll, node) ((sp_ll_type(ll) *) (node)->data)
+/* Size of a single node allocation of `ll`, header included. */
+#define sp_ll_node_size(ll) (sizeof(sp_ll_node) + sizeof((ll)->type))
+#define sp_ll_node_align(ll) \
+    (_Alignof(sp_ll_type(ll)) > _Alignof(sp_ll_node) ? _Alignof(sp_ll_type(ll)) : _Alignof(sp_ll_node))
+
+/* Node pool backing `ll`; the list's own pool follows the list's allocator. */
+#define __sp_ll_pool(ll) ((ll)->pool ? (ll)->pool : ((ll)->nodes.allocator = (ll)->allocator, &(ll)->nodes))
+#define __sp_ll_node_alloc(ll) \
+    ((sp_ll_node *) sp_node_pool_alloc(__sp_ll_pool(ll), sp_ll_node_size(ll), sp_ll_node_align(ll)))
+
+#define sp_ll_push_back(ll, element)                              \
+    do {                                                          \
+        sp_ll_node *macro_var(llp_node) = __sp_ll_node_alloc(ll); \
+        *sp_ll_node_unwrap(ll, macro_var(llp_node)) = (element);  \
+        macro_var(llp_node)->next = NULL;                         \
+        macro_var(llp_node)->prev = (ll)->tail;                   \
+        if ((ll)->tail == NULL) { /* uninitialized state */       \
+            (ll)->head = macro_var(llp_node);                     \
+        } else {                                                  \
+            (ll)->tail->next = macro_var(llp_node);               \
+        }                                                         \
+        (ll)->tail = macro_var(llp_node);                         \
+    } while (0)
+
+#define sp_ll_push_front(ll, element)                             \
+    do {                                                          \
+        sp_ll_node *macro_var(llp_node) = __sp_ll_node_alloc(ll); \
+        *sp_ll_node_unwrap(ll, macro_var(llp_node)) = (element);  \
+        macro_var(llp_node)->prev = NULL;                         \
+        macro_var(llp_node)->next = (ll)->head;                   \
+        if ((ll)->head == NULL) { /* uninitialized state */       \
+            (ll)->tail = macro_var(llp_node);                     \
+        } else {                                                  \
+            (ll)->head->prev = macro_var(llp_node);               \
+        }                                                         \
+        (ll)->head = macro_var(llp_node);                         \
+    } while (0)
+
+// TODO: Make sp_ll_pop use a common backend for common functions
+
+#define sp_ll_pop_back(ll)                                                        \
+    do {                                                                          \
+        if ((ll)->head == NULL && (ll)->tail == NULL) { /* uninitialized state */ \
+            break;                                                                \
+        } else if ((ll)->head == (ll)->tail) { /* count == 1 */                   \
+            sp_node_pool_release(__sp_ll_pool(ll), (ll)->head);                   \
+            (ll)->head = NULL;                                                    \
+            (ll)->tail = NULL;                                                    \
+        } else {                                                                  \
+            (ll)->tail = (ll)->tail->prev;                                        \
+            sp_node_pool_release(__sp_ll_pool(ll), (ll)->tail->next);             \
+            (ll)->tail->next = NULL;                                              \
+        }                                                                         \
+    } while (0)
+
+#define sp_ll_pop_front(ll)                                                       \
+    do {                                                                          \
+        if ((ll)->head == NULL && (ll)->tail == NULL) { /* uninitialized state */ \
+            break;                                                                \
+        } else if ((ll)->head == (ll)->tail) { /* count == 1 */                   \
+            sp_node_pool_release(__sp_ll_pool(ll), (ll)->head);                   \
+            (ll)->head = NULL;                                                    \
             (ll)->tail = NULL;                                                    \
         } else {                                                                  \
             (ll)->head = (ll)->head->next;                                        \
-            free((ll)->head->prev);                                               \
+            sp_node_pool_release(__sp_ll_pool(ll), (ll)->head->prev);             \
             (ll)->head->prev = NULL;                                              \
         }                                                                         \
     } while (0)
 
-#define sp_ll_free(ll)               \
-    do {                             \
-        void *next;                  \
-        while ((ll)->head) {         \
-            next = (ll)->head->next; \
-            free((ll)->head);        \
-            (ll)->head = next;       \
-        }                            \
-        (ll)->head = NULL;           \
-        (ll)->tail = NULL;           \
-    } while (0)
+/* Frees the list's own pool in one go, or hands every node back to a shared `pool`. */
+#define sp_ll_free(ll)                                        \
+    do {                                                      \
+        if ((ll)->pool) {                                     \
+            sp_ll_node *next;                                 \
+            while ((ll)->head) {                              \
+                next = (ll)->head->next;                      \
+                sp_node_pool_release((ll)->pool, (ll)->head); \
+                (ll)->head = next;                            \
+            }                                                 \
+        } else {                                              \
+            (ll)->nodes.allocator = (ll)->allocator;          \
+            sp_node_pool_free(&(ll)->nodes);                  \
+        }                                                     \
+        (ll)->head = NULL;                                    \
+        (ll)->tail = NULL;                                    \
+    } while (0)
+
+/*
+ * Unrolled doubly linked list: each node packs up to `sp_ul_node_cap(ul)` elements contiguously in
+ * `data[begin, end)`, so traversal walks arrays and pointer overhead is shared by a whole node.
+ *
+ * Iterate with:
+ *   for (sp_ul_node *node = ul.head; node; node = node->next)
+ *       for (size_t i = node->begin; i < node->end; ++i) sp_ul_node_data(&ul, node)[i];
+ */
+#ifndef SP_UL_NODE_BYTES
+#define SP_UL_NODE_BYTES 512
+#endif
+
+typedef struct sp_ul_node {
+    struct sp_ul_node *prev;
+    struct sp_ul_node *next;
+    size_t begin;
+    size_t end;
+    _Alignas(max_align_t) unsigned char data[];
+} sp_ul_node;
+
+#define Sp_Unrolled_List(T)            \
+    struct {                           \
+        T type;                        \
+        sp_ul_node *head;              \
+        sp_ul_node *tail;              \
+        size_t count;                  \
+        const Sp_Allocator *allocator; \
+    }
+
+/* Returns a pointer of the list's element type to the start of `node`'s element storage. */
+#define sp_ul_node_data(ul, node) ((__typeof__((ul)->type) *) (void *) (node)->data)
+/* Elements per node: as many as fit in `SP_UL_NODE_BYTES`, at least one. */
+#define sp_ul_node_cap(ul)                                      \
+    (sizeof((ul)->type) + sizeof(sp_ul_node) > SP_UL_NODE_BYTES \
+         ? (size_t) 1                                           \
+         : (SP_UL_NODE_BYTES - sizeof(sp_ul_node)) / sizeof((ul)->type))
+#define sp_ul_node_size(ul) (sizeof(sp_ul_node) + sp_ul_node_cap(ul) * sizeof((ul)->type))
+
+#define sp_ul_front(ul) (sp_ul_node_data(ul, (ul)->head)[(ul)->head->begin])
+#define sp_ul_back(ul) (sp_ul_node_data(ul, (ul)->tail)[(ul)->tail->end - 1])
+
+#define sp_ul_push_back(ul, element)                                                          \
+    do {                                                                                      \
+        if ((ul)->tail == NULL || (ul)->tail->end == sp_ul_node_cap(ul)) {                    \
+            sp_ul_node *macro_var(ulp_node) = sp_alloc((ul)->allocator, sp_ul_node_size(ul)); \
+            macro_var(ulp_node)->begin = 0;                                                   \
+            macro_var(ulp_node)->end = 0;                                                     \
+            macro_var(ulp_node)->next = NULL;                                                 \
+            macro_var(ulp_node)->prev = (ul)->tail;                                           \
+            if ((ul)->tail) {                                                                 \
+                (ul)->tail->next = macro_var(ulp_node);                                       \
+            } else {                                                                          \
+                (ul)->head = macro_var(ulp_node);                                             \
+            }                                                                                 \
+            (ul)->tail = macro_var(ulp_node);                                                 \
+        }                                                                                     \
+        sp_ul_node_data(ul, (ul)->tail)[(ul)->tail->end++] = (element);                       \
+        ++(ul)->count;                                                                        \
+    } while (0)
+
+#define sp_ul_push_front(ul, element)                                                         \
+    do {                                                                                      \
+        if ((ul)->head == NULL || (ul)->head->begin == 0) {                                   \
+            sp_ul_node *macro_var(ulp_node) = sp_alloc((ul)->allocator, sp_ul_node_size(ul)); \
+            macro_var(ulp_node)->begin = sp_ul_node_cap(ul);                                  \
+            macro_var(ulp_node)->end = sp_ul_node_cap(ul);                                    \
+            macro_var(ulp_node)->prev = NULL;                                                 \
+            macro_var(ulp_node)->next = (ul)->head;                                           \
+            if ((ul)->head) {                                                                 \
+                (ul)->head->prev = macro_var(ulp_node);                                       \
+            } else {                                                                          \
+                (ul)->tail = macro_var(ulp_node);                                             \
+            }                                                                                 \
+            (ul)->head = macro_var(ulp_node);                                                 \
+        }                                                                                     \
+        sp_ul_node_data(ul, (ul)->head)[--(ul)->head->begin] = (element);                     \
+        ++(ul)->count;                                                                        \
+    } while (0)
+
+/* Unlinks and frees `node` from `ul`. */
+#define __sp_ul_unlink(ul, node)                                            \
+    do {                                                                    \
+        sp_ul_node *macro_var(ulu_node) = (node);                           \
+        if (macro_var(ulu_node)->prev) {                                    \
+            macro_var(ulu_node)->prev->next = macro_var(ulu_node)->next;    \
+        } else {                                                            \
+            (ul)->head = macro_var(ulu_node)->next;                         \
+        }                                                                   \
+        if (macro_var(ulu_node)->next) {                                    \
+            macro_var(ulu_node)->next->prev = macro_var(ulu_node)->prev;    \
+        } else {                                                            \
+            (ul)->tail = macro_var(ulu_node)->prev;                         \
+        }                                                                   \
+        sp_free((ul)->allocator, macro_var(ulu_node), sp_ul_node_size(ul)); \
+    } while (0)
+
+#define sp_ul_pop_back(ul)                            \
+    do {                                              \
+        if ((ul)->count == 0) {                       \
+            break;                                    \
+        }                                             \
+        --(ul)->count;                                \
+        if (--(ul)->tail->end == (ul)->tail->begin) { \
+            __sp_ul_unlink(ul, (ul)->tail);           \
+        }                                             \
+    } while (0)
+
+#define sp_ul_pop_front(ul)                           \
+    do {                                              \
+        if ((ul)->count == 0) {                       \
+            break;                                    \
+        }                                             \
+        --(ul)->count;                                \
+        if (++(ul)->head->begin == (ul)->head->end) { \
+            __sp_ul_unlink(ul, (ul)->head);           \
+        }                                             \
+    } while (0)
+
+/* Moves every element of `src` to the back of `dst` in O(1), leaving `src` empty. Both lists must share an
+ * allocator and element type. */
+#define sp_ul_splice(dst, src)                              \
+    do {                                                    \
+        assert((dst)->allocator == (src)->allocator);       \
+        assert(sizeof((dst)->type) == sizeof((src)->type)); \
+        if ((src)->head == NULL) {                          \
+            break;                                          \
+        }                                                   \
+        if ((dst)->tail) {                                  \
+            (dst)->tail->next = (src)->head;                \
+            (src)->head->prev = (dst)->tail;                \
+        } else {                                            \
+            (dst)->head = (src)->head;                      \
+        }                                                   \
+        (dst)->tail = (src)->tail;                          \
+        (dst)->count += (src)->count;                       \
+        (src)->head = NULL;                                 \
+        (src)->tail = NULL;                                 \
+        (src)->count = 0;                                   \
+    } while (0)
+
+#define sp_ul_free(ul)                                                 \
+    do {                                                               \
+        sp_ul_node *next;                                              \
+        while ((ul)->head) {                                           \
+            next = (ul)->head->next;                                   \
+            sp_free((ul)->allocator, (ul)->head, sp_ul_node_size(ul)); \
+            (ul)->head = next;                                         \
+        }                                                              \
+        (ul)->tail = NULL;                                             \
+        (ul)->count = 0;                                               \
+    } while (0)
+
+#define FNV_PRIME_32 16777619
+#define FNV_OFFSET_BASIS_32 2166136261
+
+static inline uint32_t hash_fnv(const char *const *data, const size_t bytes) {
+    assert(data);
+
+    uint32_t hash = FNV_OFFSET_BASIS_32;
+
+    for (size_t i = 0; i < bytes; ++i) {
+        hash = (hash ^ (unsigned) (*data)[i]) * FNV_PRIME_32;
+    }
+
+    return hash;
+}
+
+static inline uint32_t sp_cstr_hash_fnv(const char *const *cstr) {
+    assert(cstr);
+    return hash_fnv(cstr, strlen(*cstr));
+}
+
+static inline uint32_t sp_sv_hash_fnv(const Sp_String_View *slice) {
+    assert(slice);
+    return hash_fnv(&slice->ptr, slice->count);
+}
+
+/*
+ * 64-bit hash in the wyhash family: reads 16 bytes per step (48 per step for long inputs) and folds them with
+ * 64x64->128-bit multiplies instead of touching every byte. A non-zero `seed` randomizes the output, e.g. to keep
+ * adversarial keys from being crafted against a table.
+ */
+#define SP_HASH_SECRET_0 0xa0761d6478bd642full
+#define SP_HASH_SECRET_1 0xe7037ed1a0b428dbull
+#define SP_HASH_SECRET_2 0x8ebc6af09c88c6e3ull
+#define SP_HASH_SECRET_3 0x589965cc75374cc3ull
+
+/* 64x64->128-bit multiply, returning the low half in `*a` and the high half in `*b`. */
+static inline void sp_hash_mum(uint64_t *a, uint64_t *b) {
+#if defined(__SIZEOF_INT128__)
+    __extension__ typedef unsigned __int128 sp_u128;
+    const sp_u128 r = (sp_u128) *a * *b;
+    *a = (uint64_t) r;
+    *b = (uint64_t) (r >> 64);
+#else
+    const uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t) *a, lb = (uint32_t) *b;
+    const uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb, t = rl + (rm0 << 32);
+    uint64_t c = t < rl;
+    const uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t sp_hash_mix(uint64_t a, uint64_t b) {
+    sp_hash_mum(&a, &b);
+    return a ^ b;
+}
+
+static inline uint64_t sp_hash_read64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t sp_hash_read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t sp_hash_bytes(const void *data, size_t bytes, uint64_t seed) {
+    assert(data || bytes == 0);
+
+    const uint8_t *p = data;
+    uint64_t a = 0, b = 0;
+
+    seed ^= sp_hash_mix(seed ^ SP_HASH_SECRET_0, SP_HASH_SECRET_1);
+
+    if (bytes <= 16) {
+        if (bytes >= 4) {
+            const size_t mid = (bytes >> 3) << 2;
+            a = (sp_hash_read32(p) << 32) | sp_hash_read32(p + mid);
+            b = (sp_hash_read32(p + bytes - 4) << 32) | sp_hash_read32(p + bytes - 4 - mid);
+        } else if (bytes > 0) {
+            a = ((uint64_t) p[0] << 16) | ((uint64_t) p[bytes >> 1] << 8) | p[bytes - 1];
+        }
+    } else {
+        size_t i = bytes;
+        if (i > 48) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = sp_hash_mix(sp_hash_read64(p) ^ SP_HASH_SECRET_1, sp_hash_read64(p + 8) ^ seed);
+                see1 = sp_hash_mix(sp_hash_read64(p + 16) ^ SP_HASH_SECRET_2, sp_hash_read64(p + 24) ^ see1);
+                see2 = sp_hash_mix(sp_hash_read64(p + 32) ^ SP_HASH_SECRET_3, sp_hash_read64(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = sp_hash_mix(sp_hash_read64(p) ^ SP_HASH_SECRET_1, sp_hash_read64(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = sp_hash_read64(p + i - 16);
+        b = sp_hash_read64(p + i - 8);
+    }
+
+    a ^= SP_HASH_SECRET_1;
+    b ^= seed;
+    sp_hash_mum(&a, &b);
+    return sp_hash_mix(a ^ SP_HASH_SECRET_0 ^ bytes, b ^ SP_HASH_SECRET_1);
+}
+
+static inline uint64_t sp_cstr_hash(const char *const *cstr, uint64_t seed) {
+    assert(cstr);
+    return sp_hash_bytes(*cstr, strlen(*cstr), seed);
+}
+
+static inline uint64_t sp_sv_hash(const Sp_String_View *slice, uint64_t seed) {
+    assert(slice);
+    return sp_hash_bytes(slice->ptr, slice->count, seed);
+}
+
+/*
+ * String view that carries its own `sp_sv_hash(&sv, 0)`. As an `Sp_Hash_Table` key it is never re-hashed: lookups
+ * use the stored hash (mixed with the table's `seed` if one is set), growth moves keys without touching their
+ * characters, and mismatching keys are rejected on the hash before their bytes are compared. Build keys for
+ * constant lookups once, e.g. `static Sp_Hashed_View key; if (!key.sv.ptr) key = SP_HASHED_LIT("Bob");`.
+ */
+typedef struct {
+    Sp_String_View sv;
+    uint64_t hash;
+} Sp_Hashed_View;
+
+static inline Sp_Hashed_View sp_hashed_view(Sp_String_View sv) {
+    return (Sp_Hashed_View) {.sv = sv, .hash = sp_hash_bytes(sv.ptr, sv.count, 0)};
+}
+#define SP_HASHED_LIT(literal) sp_hashed_view(SP_SV_LIT(literal))
+
+/* murmur3's fmix64 finalizer over `value ^ seed`; every input bit affects every output bit. */
+static inline uint64_t sp_hash_u64(uint64_t value, uint64_t seed) {
+    value ^= seed;
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdull;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ull;
+    value ^= value >> 33;
+    return value;
+}
+
+static inline uint64_t sp_hashed_view_hash(const Sp_Hashed_View *key, uint64_t seed) {
+    assert(key);
+    return seed ? sp_hash_u64(key->hash, seed) : key->hash;
+}
+
+static inline uint32_t sp_hashed_view_eq(const Sp_Hashed_View *lhs, const Sp_Hashed_View *rhs) {
+    assert(lhs);
+    assert(rhs);
+    return lhs->hash == rhs->hash && sp_sv_eq(&lhs->sv, &rhs->sv);
+}
+
+/*
+ * Hashes a fixed-size key by its object representation: integers, pointers and small PODs go through
+ * `sp_hash_u64()`, anything wider than 8 bytes through `sp_hash_bytes()`. `bytes` is meant to be a `sizeof`, which
+ * lets the branch and the copy fold into a single load once inlined.
+ */
+static inline uint64_t sp_hash_key_bytes(const void *key, size_t bytes, uint64_t seed) {
+    if (bytes <= sizeof(uint64_t)) {
+        uint64_t value = 0;
+        memcpy(&value, key, bytes);
+        return sp_hash_u64(value, seed);
+    }
+    return sp_hash_bytes(key, bytes, seed);
+}
+
+static inline uint32_t sp_ht_streq(const char *const *s1, const char *const *s2) { return (uint32_t) !strcmp(*s1, *s2); }
+
+/* `char *` keys hash and compare their characters like `const char *` ones. */
+static inline uint64_t __sp_ht_mut_cstr_hash(char *const *cstr, uint64_t seed) {
+    return sp_cstr_hash((const char *const *) cstr, seed);
+}
+
+static inline uint32_t __sp_ht_mut_streq(char *const *s1, char *const *s2) {
+    return sp_ht_streq((const char *const *) s1, (const char *const *) s2);
+}
+
+/* Floating-point keys hash their value, with -0.0 folded into 0.0, and compare with `==`. */
+static inline uint64_t __sp_ht_double_hash(const double *key, uint64_t seed) {
+    const double value = *key == 0 ? 0.0 : *key;
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return sp_hash_u64(bits, seed);
+}
+
+static inline uint64_t __sp_ht_float_hash(const float *key, uint64_t seed) {
+    const double value = *key;
+    return __sp_ht_double_hash(&value, seed);
+}
+
+static inline uint32_t __sp_ht_double_eq(const double *lhs, const double *rhs) { return *lhs == *rhs; }
+static inline uint32_t __sp_ht_float_eq(const float *lhs, const float *rhs) { return *lhs == *rhs; }
+
+/*
+ * Control bytes of an `Sp_Hash_Table` slot. A full slot stores the low 7 bits of its key's hash (h2) with the
+ * high bit set; empty and deleted (tombstone) slots have the high bit cleared, so a probe can reject most
+ * non-matching slots of a group with a single vector compare before ever touching a key. Empty is all zeroes,
+ * which lets a fresh control array come straight from `calloc`.
+ */
+#define SP_HT_CTRL_EMPTY ((uint8_t) 0x00)
+#define SP_HT_CTRL_DELETED ((uint8_t) 0x01)
+#define SP_HT_CTRL_FULL ((uint8_t) 0x80)
+#define SP_HT_GROUP_WIDTH 16
+
+#define sp_ht_h1(hash) ((size_t) ((hash) >> 7))
+#define sp_ht_h2(hash) ((uint8_t) (SP_HT_CTRL_FULL | ((hash) & 0x7F)))
+
+#if defined(__SSE2__)
+#define SP_HT_GROUP_SHIFT 0
+#elif defined(__ARM_NEON)
+#define SP_HT_GROUP_SHIFT 2 /* NEON masks are narrowed to one nibble per lane. */
+#else
+#define SP_HT_GROUP_SHIFT 0
+#endif
+
+/* Index within the group of the lowest lane set in a non-zero group match mask. */
+#define sp_ht_mask_lowest(mask) ((size_t) __builtin_ctzll(mask) >> SP_HT_GROUP_SHIFT)
+
+/* Returns a mask with one lane set for every control byte in `group` that equals `ctrl`. */
+static inline uint64_t sp_ht_group_match(const uint8_t *group, uint8_t ctrl) {
+#if defined(__SSE2__)
+    const __m128i bytes = _mm_loadu_si128((const __m128i *) group);
+    return (uint64_t) (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8((char) ctrl)));
+#elif defined(__ARM_NEON)
+    const uint8x16_t eq = vceqq_u8(vld1q_u8(group), vdupq_n_u8(ctrl));
+    const uint8x8_t narrowed = vshrn_n_u16(vreinterpretq_u16_u8(eq), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(narrowed), 0) & 0x8888888888888888ull;
+#else
+    uint64_t mask = 0;
+    for (size_t i = 0; i < SP_HT_GROUP_WIDTH; ++i) {
+        mask |= (uint64_t) (group[i] == ctrl) << i;
+    }
+    return mask;
+#endif
+}
+
+/* Returns a mask with one lane set for every slot in `group` that can take a new key. */
+static inline uint64_t sp_ht_group_match_free(const uint8_t *group) {
+#if defined(__SSE2__)
+    return (uint64_t) (uint32_t) (~_mm_movemask_epi8(_mm_loadu_si128((const __m128i *) group)) & 0xFFFF);
+#elif defined(__ARM_NEON)
+    const uint8x16_t free = vcgezq_s8(vreinterpretq_s8_u8(vld1q_u8(group)));
+    const uint8x8_t narrowed = vshrn_n_u16(vreinterpretq_u16_u8(free), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(narrowed), 0) & 0x8888888888888888ull;
+#else
+    uint64_t mask = 0;
+    for (size_t i = 0; i < SP_HT_GROUP_WIDTH; ++i) {
+        mask |= (uint64_t) !(group[i] & SP_HT_CTRL_FULL) << i;
+    }
+    return mask;
+#endif
+}
+
+/* Smallest power-of-two slot count (and at least one group) that holds `expected` slots. */
+static inline size_t sp_ht_capacity_for(size_t expected) {
+    size_t capacity = SP_HT_GROUP_WIDTH;
+    while (capacity < expected) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+/* Slot index of the first free slot on the probe sequence of `hash`. The table must have a free slot. */
+static inline size_t __sp_ht_find_free(const uint8_t *ctrl, size_t capacity, uint64_t hash) {
+    const size_t groups_mask = capacity / SP_HT_GROUP_WIDTH - 1;
+    size_t group = sp_ht_h1(hash) & groups_mask;
+    for (size_t probe = 1;; ++probe) {
+        const uint64_t mask = sp_ht_group_match_free(ctrl + group * SP_HT_GROUP_WIDTH);
+        if (mask) {
+            return group * SP_HT_GROUP_WIDTH + sp_ht_mask_lowest(mask);
+        }
+        group = (group + probe) & groups_mask; /* triangular probing visits every group */
+    }
+}
+
+/*
+ * Hash table implementation with open addressing, Swiss table style.
+ *
+ * Nodes live in one flat slot array (`table`, where `table.count == table.capacity` is the power-of-two slot count)
+ * next to a parallel array of control bytes. Lookups probe whole groups of `SP_HT_GROUP_WIDTH` control bytes at a
+ * time (SSE2/NEON when available) and only compare keys whose 7-bit hash tag matches.
+ *
+ * Re-hashes entire table at 2x capacity on insertion when load factor reaches the ratio as defined by
+ * `SP_HT_LOAD_CAPACITY` (default = 0.75). Removed slots are left as tombstones, which count towards the load
+ * factor; once they fill the table up, it is re-hashed in place at the same capacity instead of grown.
+ *
+ * Keys are hashed and compared with `hash`/`equal` when those are set. Otherwise the built-in hashing is expanded
+ * inline at every call site, without an indirect call: `const char *`, `char *` and `Sp_String_View` keys hash their
+ * characters (`Sp_Hashed_View` keys bring theirs precomputed), `float` and `double` keys hash their value and
+ * compare with `==` (so -0.0 and 0.0 are one key, and a NaN key is never found), and every other key type
+ * (integers, pointers, POD structs without padding) is hashed and compared by its bytes. Any other pointer key, e.g.
+ * `const uint8_t *`, is therefore compared by address, not by what it points to; set `hash`/`equal` for content
+ * keys. Hashes are seeded with `seed`, which must be chosen before the first insertion.
+ *
+ * Setting `incremental` to non-zero makes re-hashing incremental: the old slot array is kept next to the new one
+ * and every subsequent operation migrates at most `SP_HT_MIGRATE_STEP` of its slots, so no single insertion pays
+ * for moving the whole table. Lookups consult both arrays until the migration is done.
+ */
+#define Sp_Hash_Table(K, T)                      \
+    struct {                                     \
+        Sp_Dynamic_Array(struct {                \
+            K key;                               \
+            T value;                             \
+        }) table;                                \
+        uint8_t *ctrl;                           \
+        size_t count;                            \
+        size_t tombstones;                       \
+        int incremental;                         \
+        void *old_slots;                         \
+        uint8_t *old_ctrl;                       \
+        size_t old_capacity;                     \
+        size_t migrate_idx;                      \
+        uint64_t seed;                           \
+        uint64_t (*hash)(K const *, uint64_t);   \
+        uint32_t (*equal)(K const *, K const *); \
+        const Sp_Allocator *allocator;           \
+    }
+
+#define sp_ht_node_t(ht) __typeof__(*(ht)->table.data)
+#define sp_ht_key_type(ht) __typeof__((ht)->table.data->key)
+#define sp_ht_value_type(ht) __typeof__((ht)->table.data->value)
+
+/* Whether slot `idx` of `ht->table` holds a node; use this to iterate over a table. An incremental table must
+ * be settled with `sp_ht_finish_rehash()` first, or nodes still in the old slot array are missed. */
+#define sp_ht_slot_full(ht, idx) (((ht)->ctrl[idx] & SP_HT_CTRL_FULL) != 0)
+
+/* Whether `ht` has string or floating-point keys, which are hashed and compared by value instead of by their bytes. */
+#define __sp_ht_typed_key(ht)       \
+    _Generic((ht)->table.data->key, \
+        const char *: 1, char *: 1, Sp_String_View: 1, Sp_Hashed_View: 1, float: 1, double: 1, default: 0)
+
+/* `_Generic` only picks a typed function for those keys; the `(ht)->hash`/`(ht)->equal` fallbacks are never
+ * called, they only give the unselected association a matching type. */
+#define sp_ht_hash_key(ht, key_ptr)                        \
+    ((ht)->hash ? (ht)->hash((key_ptr), (ht)->seed)        \
+     : __sp_ht_typed_key(ht)                               \
+         ? _Generic((ht)->table.data->key,                 \
+               const char *: sp_cstr_hash,                 \
+               char *: __sp_ht_mut_cstr_hash,              \
+               Sp_String_View: sp_sv_hash,                 \
+               Sp_Hashed_View: sp_hashed_view_hash,        \
+               float: __sp_ht_float_hash,                  \
+               double: __sp_ht_double_hash,                \
+               default: (ht)->hash)((key_ptr), (ht)->seed) \
+         : sp_hash_key_bytes((key_ptr), sizeof(*(key_ptr)), (ht)->seed))
+
+#define sp_ht_key_eq(ht, lhs_ptr, rhs_ptr)                 \
+    ((ht)->equal ? (ht)->equal((lhs_ptr), (rhs_ptr))       \
+     : __sp_ht_typed_key(ht)                               \
+         ? _Generic((ht)->table.data->key,                 \
+               const char *: sp_ht_streq,                  \
+               char *: __sp_ht_mut_streq,                  \
+               Sp_String_View: sp_sv_eq,                   \
+               Sp_Hashed_View: sp_hashed_view_eq,          \
+               float: __sp_ht_float_eq,                    \
+               double: __sp_ht_double_eq,                  \
+               default: (ht)->equal)((lhs_ptr), (rhs_ptr)) \
+         : !memcmp((lhs_ptr), (rhs_ptr), sizeof(*(lhs_ptr))))
+
+#define SP_HT_LOAD_CAPACITY 0.75
+#define SP_HT_INIT_CAP SP_HT_GROUP_WIDTH
+#define SP_HT_MIGRATE_STEP (2 * SP_HT_GROUP_WIDTH)
+
+#define sp_ht_max_load(capacity) ((size_t) (SP_HT_LOAD_CAPACITY * (double) (capacity)))
+
+#define __sp_ht_old_slots(ht) ((sp_ht_node_t(ht) *) (ht)->old_slots)
+
+/* Moves the full slots of the old slot array in [migrate_idx, migrate_idx + __step__) into `ht->table`, and
+ * releases the old array once it has been walked completely. */
+#define __sp_ht_migrate(ht, __step__)                                                                               \
+    do {                                                                                                            \
+        if (!(ht)->old_slots) break;                                                                                \
+        size_t macro_var(mg_end) = (ht)->migrate_idx + (__step__);                                                  \
+        if (macro_var(mg_end) > (ht)->old_capacity) macro_var(mg_end) = (ht)->old_capacity;                         \
+        for (; (ht)->migrate_idx < macro_var(mg_end); ++(ht)->migrate_idx) {                                        \
+            if (!((ht)->old_ctrl[(ht)->migrate_idx] & SP_HT_CTRL_FULL)) continue;                                   \
+            (ht)->old_ctrl[(ht)->migrate_idx] = SP_HT_CTRL_DELETED;                                                 \
+            const uint64_t macro_var(mg_h) = sp_ht_hash_key((ht), &__sp_ht_old_slots(ht)[(ht)->migrate_idx].key);   \
+            const size_t macro_var(mg_slot) = __sp_ht_find_free((ht)->ctrl, (ht)->table.capacity, macro_var(mg_h)); \
+            (ht)->ctrl[macro_var(mg_slot)] = sp_ht_h2(macro_var(mg_h));                                             \
+            (ht)->table.data[macro_var(mg_slot)] = __sp_ht_old_slots(ht)[(ht)->migrate_idx];                        \
+        }                                                                                                           \
+        if ((ht)->migrate_idx == (ht)->old_capacity) {                                                              \
+            sp_free((ht)->allocator, (ht)->old_slots, (ht)->old_capacity * sizeof(*(ht)->table.data));              \
+            sp_free((ht)->allocator, (ht)->old_ctrl, (ht)->old_capacity);                                           \
+            (ht)->old_slots = NULL;                                                                                 \
+            (ht)->old_ctrl = NULL;                                                                                  \
+            (ht)->old_capacity = 0;                                                                                 \
+            (ht)->migrate_idx = 0;                                                                                  \
+        }                                                                                                           \
+    } while (0)
+
+/* Completes an in-progress incremental re-hash, after which every node lives in `ht->table`. */
+#define sp_ht_finish_rehash(ht) __sp_ht_migrate((ht), SIZE_MAX - (ht)->migrate_idx)
+
+/*
+ * Re-builds `ht` with `__capacity__` slots, dropping all tombstones. Incremental tables only swap the slot arrays
+ * here and leave moving the nodes to `__sp_ht_migrate()`; otherwise every node is re-hashed right away.
+ */
+#define __sp_ht_rehash(ht, __capacity__)                                                                       \
+    do {                                                                                                       \
+        const size_t macro_var(rh_new_cap) = (__capacity__);                                                   \
+        sp_ht_finish_rehash(ht);                                                                               \
+        (ht)->old_slots = (ht)->table.data;                                                                    \
+        (ht)->old_ctrl = (ht)->ctrl;                                                                           \
+        (ht)->old_capacity = (ht)->table.capacity;                                                             \
+        (ht)->migrate_idx = 0;                                                                                 \
+        (ht)->table.data = sp_alloc_zeroed((ht)->allocator, macro_var(rh_new_cap), sizeof(*(ht)->table.data)); \
+        (ht)->table.count = macro_var(rh_new_cap);                                                             \
+        (ht)->table.capacity = macro_var(rh_new_cap);                                                          \
+        (ht)->ctrl = sp_alloc_zeroed((ht)->allocator, macro_var(rh_new_cap), sizeof(*(ht)->ctrl));             \
+        (ht)->tombstones = 0;                                                                                  \
+        if (!(ht)->incremental) sp_ht_finish_rehash(ht);                                                       \
+    } while (0)
+
+/* Grows the table to hold at least `__expected__` slots (rounded up to a power of two), re-hashing every node. */
+#define sp_ht_reserve(ht, __expected__)                                     \
+    do {                                                                    \
+        const size_t macro_var(rsv_cap) = sp_ht_capacity_for(__expected__); \
+        if (macro_var(rsv_cap) > (ht)->table.capacity) {                    \
+            __sp_ht_rehash((ht), macro_var(rsv_cap));                       \
+            sp_ht_finish_rehash(ht);                                        \
+        }                                                                   \
+    } while (0)
+
+/*
+ * Makes room for one more node: allocates the table on first use, and otherwise re-hashes once live nodes plus
+ * tombstones exceed the load factor. The table only doubles when live nodes take up more than half of the
+ * allowed load; otherwise the re-hash just compacts tombstones away at the same capacity. Also advances an
+ * in-progress incremental re-hash by one step.
+ */
+#define __sp_ht_reserve_one(ht)                                                                 \
+    do {                                                                                        \
+        __sp_ht_migrate((ht), SP_HT_MIGRATE_STEP);                                              \
+        if ((ht)->table.capacity == 0) {                                                        \
+            sp_ht_reserve((ht), SP_HT_INIT_CAP);                                                \
+        } else if ((ht)->count + (ht)->tombstones + 1 > sp_ht_max_load((ht)->table.capacity)) { \
+            __sp_ht_rehash((ht), (ht)->count + 1 > sp_ht_max_load((ht)->table.capacity) / 2     \
+                                     ? (ht)->table.capacity * 2                                 \
+                                     : (ht)->table.capacity);                                   \
+        }                                                                                       \
+    } while (0)
+
+/*
+ * Probes the slot array `slots` (with control bytes `ctrl` and `capacity` slots) of `ht` for the key pointed to by
+ * `key_ptr`, whose hash is `__hash__`. Sets `*out_slot` to the slot holding the key, or SIZE_MAX if absent, and
+ * `*free_slot` to the first free slot seen on the probe sequence, i.e. where the key belongs if it has to be
+ * inserted. Stops at the first match.
+ */
+#define __sp_ht_probe(ht, slots, ctrl, capacity, key_ptr, __hash__, out_slot, free_slot)                               \
+    do {                                                                                                               \
+        const uint64_t macro_var(probe_h) = (__hash__);                                                                \
+        const uint8_t macro_var(probe_h2) = sp_ht_h2(macro_var(probe_h));                                              \
+        const size_t macro_var(probe_mask) = (capacity) / SP_HT_GROUP_WIDTH - 1;                                       \
+        size_t macro_var(probe_group) = sp_ht_h1(macro_var(probe_h)) & macro_var(probe_mask);                          \
+        *(out_slot) = SIZE_MAX;                                                                                        \
+        *(free_slot) = SIZE_MAX;                                                                                       \
+        for (size_t macro_var(probe_n) = 1;; ++macro_var(probe_n)) {                                                   \
+            const size_t macro_var(probe_base) = macro_var(probe_group) * SP_HT_GROUP_WIDTH;                           \
+            const uint8_t *macro_var(probe_ctrl) = (ctrl) + macro_var(probe_base);                                     \
+            uint64_t macro_var(probe_hits) = sp_ht_group_match(macro_var(probe_ctrl), macro_var(probe_h2));            \
+            while (macro_var(probe_hits)) {                                                                            \
+                const size_t macro_var(probe_slot) = macro_var(probe_base) + sp_ht_mask_lowest(macro_var(probe_hits)); \
+                if (sp_ht_key_eq((ht), (key_ptr), &(slots)[macro_var(probe_slot)].key)) {                              \
+                    *(out_slot) = macro_var(probe_slot);                                                               \
+                    break;                                                                                             \
+                }                                                                                                      \
+                macro_var(probe_hits) &= macro_var(probe_hits) - 1;                                                    \
+            }                                                                                                          \
+            if (*(out_slot) != SIZE_MAX) break;                                                                        \
+            const uint64_t macro_var(probe_free) = sp_ht_group_match_free(macro_var(probe_ctrl));                      \
+            if (macro_var(probe_free) && *(free_slot) == SIZE_MAX) {                                                   \
+                *(free_slot) = macro_var(probe_base) + sp_ht_mask_lowest(macro_var(probe_free));                       \
+            }                                                                                                          \
+            if (sp_ht_group_match(macro_var(probe_ctrl), SP_HT_CTRL_EMPTY)) break;                                     \
+            macro_var(probe_group) = (macro_var(probe_group) + macro_var(probe_n)) & macro_var(probe_mask);            \
+        }                                                                                                              \
+    } while (0)
+
+/*
+ * Looks up the key pointed to by `key_ptr` in the table and, during an incremental re-hash, in the old slot array.
+ * Sets `*out_node` to its node or NULL if absent, and `*old_slot` to its slot in the old array (SIZE_MAX if the
+ * node is in `ht->table`). Advances an in-progress incremental re-hash by one step first.
+ */
+#define __sp_ht_lookup(ht, key_ptr, out_node, old_slot)                                                     \
+    do {                                                                                                    \
+        *(out_node) = NULL;                                                                                 \
+        *(old_slot) = SIZE_MAX;                                                                             \
+        if ((ht)->table.capacity == 0) break;                                                               \
+        __sp_ht_migrate((ht), SP_HT_MIGRATE_STEP);                                                          \
+        const uint64_t macro_var(lu_h) = sp_ht_hash_key((ht), (key_ptr));                                   \
+        size_t macro_var(lu_slot), macro_var(lu_free);                                                      \
+        __sp_ht_probe((ht), (ht)->table.data, (ht)->ctrl, (ht)->table.capacity, (key_ptr), macro_var(lu_h), \
+                      &macro_var(lu_slot), &macro_var(lu_free));                                            \
+        if (macro_var(lu_slot) != SIZE_MAX) {                                                               \
+            *(out_node) = &(ht)->table.data[macro_var(lu_slot)];                                            \
+        } else if ((ht)->old_slots) {                                                                       \
+            __sp_ht_probe((ht), __sp_ht_old_slots(ht), (ht)->old_ctrl, (ht)->old_capacity, (key_ptr),       \
+                          macro_var(lu_h), (old_slot), &macro_var(lu_free));                                \
+            if (*(old_slot) != SIZE_MAX) *(out_node) = &__sp_ht_old_slots(ht)[*(old_slot)];                 \
+        }                                                                                                   \
+    } while (0)
+
+/*
+ * Finds or claims the slot for the key pointed to by `key_ptr` with a single hash and probe; room for a new node
+ * must have been made beforehand. Sets `*out_slot` to the slot and `*inserted` to whether the key was absent, in
+ * which case the key is stored but the value is left for the caller to fill in. A key still waiting in the old
+ * slot array of an incremental re-hash is moved over to its new slot.
+ */
+#define __sp_ht_upsert(ht, key_ptr, out_slot, inserted)                                                      \
+    do {                                                                                                     \
+        const uint64_t macro_var(ups_h) = sp_ht_hash_key((ht), (key_ptr));                                   \
+        size_t macro_var(ups_free), macro_var(ups_old) = SIZE_MAX, macro_var(ups_old_free);                  \
+        __sp_ht_probe((ht), (ht)->table.data, (ht)->ctrl, (ht)->table.capacity, (key_ptr), macro_var(ups_h), \
+                      (out_slot), &macro_var(ups_free));                                                     \
+        if (*(out_slot) == SIZE_MAX && (ht)->old_slots) {                                                    \
+            __sp_ht_probe((ht), __sp_ht_old_slots(ht), (ht)->old_ctrl, (ht)->old_capacity, (key_ptr),        \
+                          macro_var(ups_h), &macro_var(ups_old), &macro_var(ups_old_free));                  \
+        }                                                                                                    \
+        *(inserted) = *(out_slot) == SIZE_MAX && macro_var(ups_old) == SIZE_MAX;                             \
+        if (*(out_slot) == SIZE_MAX) {                                                                       \
+            *(out_slot) = macro_var(ups_free);                                                               \
+            if ((ht)->ctrl[*(out_slot)] == SP_HT_CTRL_DELETED) --(ht)->tombstones;                           \
+            (ht)->ctrl[*(out_slot)] = sp_ht_h2(macro_var(ups_h));                                            \
+            if (*(inserted)) {                                                                               \
+                (ht)->table.data[*(out_slot)].key = *(key_ptr);                                              \
+                ++(ht)->count;                                                                               \
+            } else {                                                                                         \
+                (ht)->old_ctrl[macro_var(ups_old)] = SP_HT_CTRL_DELETED;                                     \
+                (ht)->table.data[*(out_slot)] = __sp_ht_old_slots(ht)[macro_var(ups_old)];                   \
+            }                                                                                                \
+        }                                                                                                    \
+    } while (0)
+
+/* Points `sp_ht_node_t_ptr` to the `sp_ht_node_t` instance containing the key, or NULL if not found.
+ * Probing stops at the first match. This pointer can be invalidated by any subsequent instructions to the
+ * `Sp_Hash_Table` object. */
+#define sp_ht_get(ht, __key__, sp_ht_node_t_ptr)                                            \
+    do {                                                                                    \
+        const sp_ht_key_type(ht) macro_var(get_key) = (__key__);                            \
+        size_t macro_var(get_old);                                                          \
+        __sp_ht_lookup((ht), &macro_var(get_key), (sp_ht_node_t_ptr), &macro_var(get_old)); \
+    } while (0)
+
+/* Points `sp_ht_value_ptr` to the value stored under the key, or NULL if not found. Same rules as `sp_ht_get()`. */
+#define sp_ht_find(ht, __key__, sp_ht_value_ptr)                                                 \
+    do {                                                                                         \
+        const sp_ht_key_type(ht) macro_var(find_key) = (__key__);                                \
+        sp_ht_node_t(ht) *macro_var(find_node);                                                  \
+        size_t macro_var(find_old);                                                              \
+        __sp_ht_lookup((ht), &macro_var(find_key), &macro_var(find_node), &macro_var(find_old)); \
+        *(sp_ht_value_ptr) = macro_var(find_node) ? &macro_var(find_node)->value : NULL;         \
+    } while (0)
+
+#define sp_ht_insert(ht, __key__, __value__)                                                  \
+    do {                                                                                      \
+        __sp_ht_reserve_one(ht);                                                              \
+        const sp_ht_key_type(ht) macro_var(ins_key) = (__key__);                              \
+        size_t macro_var(ins_slot);                                                           \
+        int macro_var(ins_new);                                                               \
+        __sp_ht_upsert((ht), &macro_var(ins_key), &macro_var(ins_slot), &macro_var(ins_new)); \
+        (ht)->table.data[macro_var(ins_slot)].value = (__value__);                            \
+    } while (0)
+
+/*
+ * Points `sp_ht_node_t_ptr` to the node of the key, inserting it with a zero-initialized value first if it is not
+ * in the table yet. Hashes and probes once, which makes read-modify-write updates such as counters cheap:
+ *
+ *     sp_ht_get_or_insert(&ht, key, &node);
+ *     ++node->value;
+ */
+#define sp_ht_get_or_insert(ht, __key__, sp_ht_node_t_ptr)                                            \
+    do {                                                                                              \
+        __sp_ht_reserve_one(ht);                                                                      \
+        const sp_ht_key_type(ht) macro_var(goi_key) = (__key__);                                      \
+        size_t macro_var(goi_slot);                                                                   \
+        int macro_var(goi_new);                                                                       \
+        __sp_ht_upsert((ht), &macro_var(goi_key), &macro_var(goi_slot), &macro_var(goi_new));         \
+        if (macro_var(goi_new)) {                                                                     \
+            memset(&(ht)->table.data[macro_var(goi_slot)].value, 0, sizeof((ht)->table.data->value)); \
+        }                                                                                             \
+        *(sp_ht_node_t_ptr) = &(ht)->table.data[macro_var(goi_slot)];                                 \
+    } while (0)
+
+/*
+ * Removes the key from the table, if present. The slot becomes a tombstone unless its group still has an empty
+ * slot, in which case no probe sequence can run past the group and the slot is simply marked empty again.
+ */
+#define sp_ht_remove(ht, __key__)                                                                                   \
+    do {                                                                                                            \
+        const sp_ht_key_type(ht) macro_var(rm_key) = (__key__);                                                     \
+        sp_ht_node_t(ht) *macro_var(rm_node);                                                                       \
+        size_t macro_var(rm_old);                                                                                   \
+        __sp_ht_lookup((ht), &macro_var(rm_key), &macro_var(rm_node), &macro_var(rm_old));                          \
+        if (!macro_var(rm_node)) break;                                                                             \
+        --(ht)->count;                                                                                              \
+        if (macro_var(rm_old) != SIZE_MAX) {                                                                        \
+            (ht)->old_ctrl[macro_var(rm_old)] = SP_HT_CTRL_DELETED; /* skipped by the migration */                  \
+            break;                                                                                                  \
+        }                                                                                                           \
+        const size_t macro_var(rm_slot) = (size_t) (macro_var(rm_node) - (ht)->table.data);                         \
+        const uint8_t *macro_var(rm_group) = (ht)->ctrl + (macro_var(rm_slot) & ~(size_t) (SP_HT_GROUP_WIDTH - 1)); \
+        if (sp_ht_group_match(macro_var(rm_group), SP_HT_CTRL_EMPTY)) {                                             \
+            (ht)->ctrl[macro_var(rm_slot)] = SP_HT_CTRL_EMPTY;                                                      \
+        } else {                                                                                                    \
+            (ht)->ctrl[macro_var(rm_slot)] = SP_HT_CTRL_DELETED;                                                    \
+            ++(ht)->tombstones;                                                                                     \
+        }                                                                                                           \
+    } while (0)
+
+#define sp_ht_free(ht)                                                                                        \
+    do {                                                                                                      \
+        const Sp_Allocator *macro_var(ht_allocator) = (ht)->allocator;                                        \
+        sp_free(macro_var(ht_allocator), (ht)->table.data, (ht)->table.capacity * sizeof(*(ht)->table.data)); \
+        sp_free(macro_var(ht_allocator), (ht)->ctrl, (ht)->table.capacity);                                   \
+        sp_free(macro_var(ht_allocator), (ht)->old_slots, (ht)->old_capacity * sizeof(*(ht)->table.data));    \
+        sp_free(macro_var(ht_allocator), (ht)->old_ctrl, (ht)->old_capacity);                                 \
+        memset((ht), 0, sizeof(*(ht)));                                                                       \
+        (ht)->allocator = macro_var(ht_allocator);                                                            \
+    } while (0)
+
+/*
+ * String interning: every distinct string is copied once into arena storage and given a dense 32-bit ID. Interned
+ * strings compare equal iff their IDs (or canonical view pointers) are equal, and are only ever hashed when first
+ * seen. IDs and canonical views stay valid until `sp_intern_pool_free()`.
+ *
+ * Zero-initialize before use; set `allocator` first to draw all of the pool's memory from it.
+ */
+typedef uint32_t Sp_Intern_Id;
+typedef Sp_Dynamic_Array(Sp_Intern_Id) Sp_Intern_Ids;
+#define SP_INTERN_NONE ((Sp_Intern_Id) UINT32_MAX)
+
+typedef struct Sp_Intern_Pool {
+    Sp_Arena strings;                      // null-terminated copies of the strings
+    Sp_Dynamic_Array(Sp_Hashed_View) views; // ID -> canonical view
+    Sp_Hash_Table(Sp_Hashed_View, Sp_Intern_Id) ids;
+    const Sp_Allocator *allocator;
+} Sp_Intern_Pool;
+
+static inline void __sp_intern_bind(Sp_Intern_Pool *pool) {
+    pool->strings.backing = pool->allocator;
+    pool->views.allocator = pool->allocator;
+    pool->ids.allocator = pool->allocator;
+}
+
+/* ID of `sv`, or `SP_INTERN_NONE` if it has not been interned. */
+static inline Sp_Intern_Id sp_intern_find(Sp_Intern_Pool *pool, Sp_String_View sv) {
+    assert(pool);
+    Sp_Intern_Id *id;
+    sp_ht_find(&pool->ids, sp_hashed_view(sv), &id);
+    return id ? *id : SP_INTERN_NONE;
+}
+
+/* ID of `sv`, interning a copy of it first if it is new. */
+static inline Sp_Intern_Id sp_intern(Sp_Intern_Pool *pool, Sp_String_View sv) {
+    assert(pool);
+    __sp_intern_bind(pool);
+
+    const size_t count = pool->ids.count;
+    sp_ht_node_t(&pool->ids) *node;
+    sp_ht_get_or_insert(&pool->ids, sp_hashed_view(sv), &node);
+    if (pool->ids.count == count) {
+        return node->value;
+    }
+
+    assert(pool->views.count < SP_INTERN_NONE);
+    char *copy = sp_arena_alloc_aligned(&pool->strings, sv.count + 1, 1);
+    if (sv.count > 0) {
+        memcpy(copy, sv.ptr, sv.count);
+    }
+    copy[sv.count] = '\0';
+    node->key.sv.ptr = copy; // same characters, so the node's hash and slot still hold
+    node->value = (Sp_Intern_Id) pool->views.count;
+    sp_da_push(&pool->views, node->key);
+    return node->value;
+}
+
+static inline Sp_Intern_Id sp_intern_cstr(Sp_Intern_Pool *pool, const char *cstr) {
+    return sp_intern(pool, sp_cstr_slice(cstr));
+}
+
+/* Canonical view of `id`; views of equal strings share the same `ptr`. */
+static inline Sp_String_View sp_intern_view(const Sp_Intern_Pool *pool, Sp_Intern_Id id) {
+    assert(pool);
+    assert(id < pool->views.count);
+    return pool->views.data[id].sv;
+}
+
+/* Canonical, null-terminated copy of `id`. */
+static inline const char *sp_intern_str(const Sp_Intern_Pool *pool, Sp_Intern_Id id) {
+    return sp_intern_view(pool, id).ptr;
+}
+
+/*
+ * Interns every non-empty `delim`-separated token of `buffer`, appending their IDs to `out` in order. Returns the
+ * number of tokens interned.
+ */
+static inline size_t sp_intern_split(Sp_Intern_Pool *pool, Sp_String_View buffer, char delim, Sp_Intern_Ids *out) {
+    assert(pool);
+    assert(out);
+    const size_t before = out->count;
+    Sp_String_View token;
+    while (sp_sv_split_next(&buffer, delim, &token)) {
+        if (token.count > 0) {
+            sp_da_push(out, sp_intern(pool, token));
+        }
+    }
+    return out->count - before;
+}
+
+static inline void sp_intern_pool_free(Sp_Intern_Pool *pool) {
+    assert(pool);
+    __sp_intern_bind(pool);
+    sp_ht_free(&pool->ids);
+    sp_da_free(&pool->views);
+    sp_arena_free(&pool->strings);
+}
+
+/*
+ * Growable bitset over 64-bit words: bit `idx` lives in `bits.data[idx / 64]` at position `idx % 64`. Bits past the
+ * last word read as zero, and setting one grows the set. Bulk operations run a word at a time in plain loops that
+ * compilers vectorize.
+ */
+typedef struct {
+    Sp_Dynamic_Array(uint64_t) bits;
+} Sp_Bitset;
+
+#define SP_BITSET_WORD_BITS 64
+/* Returned by `sp_bitset_find_first()`/`sp_bitset_find_next()` when there is no set bit left. */
+#define SP_BITSET_NPOS ((size_t) -1)
+
+#define sp_bitset_word_count(nbits) (((nbits) + SP_BITSET_WORD_BITS - 1) / SP_BITSET_WORD_BITS)
+
+static inline uint64_t sp_bitset_get_bitmask(size_t idx) {
+    return (uint64_t) 1 << (idx % SP_BITSET_WORD_BITS);
+}
+
+/* Grows the set to hold at least `nbits` bits; new bits are cleared. */
+static inline void sp_bitset_reserve(Sp_Bitset *bitset, size_t nbits) {
+    const size_t words = sp_bitset_word_count(nbits);
+    if (bitset->bits.count < words) sp_da_resize(&bitset->bits, words);
+}
+
+/* Logical ORs all other bits except for desired bit with 0 (keep constant).
+ * The selected bit will be ORed with 1, and thus enabled. */
+static inline void sp_bitset_set(Sp_Bitset *bitset, size_t idx) {
+    sp_bitset_reserve(bitset, idx + 1);
+    bitset->bits.data[idx / SP_BITSET_WORD_BITS] |= sp_bitset_get_bitmask(idx);
+}
+
+/* Logical ANDs all other bits except for desired bit with 1 (keep constant).
+ * The selected bit will be ANDed with 0, and thus disabled. */
+static inline void sp_bitset_reset(Sp_Bitset *bitset, size_t idx) {
+    if (idx / SP_BITSET_WORD_BITS >= bitset->bits.count) {
+        return;
+    }
+    bitset->bits.data[idx / SP_BITSET_WORD_BITS] &= ~sp_bitset_get_bitmask(idx);
+}
+
+/* Logical ANDs all other bits except for desired bit with 0 (disable).
+ * The selected bit will remain as is, and thus will return as a boolean.
+ * This is immutable. */
+static inline int sp_bitset_check(const Sp_Bitset *bitset, size_t idx) {
+    if (idx / SP_BITSET_WORD_BITS >= bitset->bits.count) {
+        return 0;
+    }
+
+    return (int) ((bitset->bits.data[idx / SP_BITSET_WORD_BITS] >> (idx % SP_BITSET_WORD_BITS)) & 1);
+}
+
+/* Mask of the bits of word `word` that fall in [begin, end). */
+static inline uint64_t __sp_bitset_range_mask(size_t word, size_t begin, size_t end) {
+    const size_t lo = word * SP_BITSET_WORD_BITS;
+    const uint64_t from = begin > lo ? ~(uint64_t) 0 << (begin - lo) : ~(uint64_t) 0;
+    const uint64_t to = end - lo < SP_BITSET_WORD_BITS ? ~(~(uint64_t) 0 << (end - lo)) : ~(uint64_t) 0;
+    return from & to;
+}
+
+/* Sets every bit in [begin, end), growing the set as needed. */
+static inline void sp_bitset_set_range(Sp_Bitset *bitset, size_t begin, size_t end) {
+    if (begin >= end) {
+        return;
+    }
+    sp_bitset_reserve(bitset, end);
+    const size_t first = begin / SP_BITSET_WORD_BITS, last = (end - 1) / SP_BITSET_WORD_BITS;
+    uint64_t *words = bitset->bits.data;
+    words[first] |= __sp_bitset_range_mask(first, begin, end);
+    for (size_t i = first + 1; i < last; ++i) {
+        words[i] = ~(uint64_t) 0;
+    }
+    if (last != first) words[last] |= __sp_bitset_range_mask(last, begin, end);
+}
+
+/* Clears every bit in [begin, end). */
+static inline void sp_bitset_clear_range(Sp_Bitset *bitset, size_t begin, size_t end) {
+    if (end > bitset->bits.count * SP_BITSET_WORD_BITS) end = bitset->bits.count * SP_BITSET_WORD_BITS;
+    if (begin >= end) {
+        return;
+    }
+    const size_t first = begin / SP_BITSET_WORD_BITS, last = (end - 1) / SP_BITSET_WORD_BITS;
+    uint64_t *words = bitset->bits.data;
+    words[first] &= ~__sp_bitset_range_mask(first, begin, end);
+    for (size_t i = first + 1; i < last; ++i) {
+        words[i] = 0;
+    }
+    if (last != first) words[last] &= ~__sp_bitset_range_mask(last, begin, end);
+}
+
+/* Number of set bits. */
+static inline size_t sp_bitset_count(const Sp_Bitset *bitset) {
+    size_t count = 0;
+    for (size_t i = 0; i < bitset->bits.count; ++i) {
+        count += (size_t) __builtin_popcountll(bitset->bits.data[i]);
+    }
+    return count;
+}
+
+/* Index of the first set bit at or after `from`, or `SP_BITSET_NPOS`. Iterate with:
+ *     for (size_t i = sp_bitset_find_first(&bs); i != SP_BITSET_NPOS; i = sp_bitset_find_next(&bs, i + 1)) */
+static inline size_t sp_bitset_find_next(const Sp_Bitset *bitset, size_t from) {
+    size_t word = from / SP_BITSET_WORD_BITS;
+    if (word >= bitset->bits.count) {
+        return SP_BITSET_NPOS;
+    }
+    uint64_t bits = bitset->bits.data[word] & (~(uint64_t) 0 << (from % SP_BITSET_WORD_BITS));
+    while (!bits) {
+        if (++word == bitset->bits.count) {
+            return SP_BITSET_NPOS;
+        }
+        bits = bitset->bits.data[word];
+    }
+    return word * SP_BITSET_WORD_BITS + (size_t) __builtin_ctzll(bits);
+}
+
+static inline size_t sp_bitset_find_first(const Sp_Bitset *bitset) { return sp_bitset_find_next(bitset, 0); }
+
+/* `dst &= src`; bits of `dst` past the end of `src` are cleared. */
+static inline void sp_bitset_and(Sp_Bitset *dst, const Sp_Bitset *src) {
+    const size_t n = dst->bits.count < src->bits.count ? dst->bits.count : src->bits.count;
+    uint64_t *d = dst->bits.data;
+    const uint64_t *s = src->bits.data;
+    for (size_t i = 0; i < n; ++i) {
+        d[i] &= s[i];
+    }
+    if (dst->bits.count > n) {
+        memset(d + n, 0, (dst->bits.count - n) * sizeof(*d));
+    }
+}
+
+/* `dst |= src`, growing `dst` to the size of `src`. */
+static inline void sp_bitset_or(Sp_Bitset *dst, const Sp_Bitset *src) {
+    if (dst->bits.count < src->bits.count) sp_da_resize(&dst->bits, src->bits.count);
+    uint64_t *d = dst->bits.data;
+    const uint64_t *s = src->bits.data;
+    for (size_t i = 0; i < src->bits.count; ++i) {
+        d[i] |= s[i];
+    }
+}
+
+/* `dst ^= src`, growing `dst` to the size of `src`. */
+static inline void sp_bitset_xor(Sp_Bitset *dst, const Sp_Bitset *src) {
+    if (dst->bits.count < src->bits.count) sp_da_resize(&dst->bits, src->bits.count);
+    uint64_t *d = dst->bits.data;
+    const uint64_t *s = src->bits.data;
+    for (size_t i = 0; i < src->bits.count; ++i) {
+        d[i] ^= s[i];
+    }
+}
+
+/* `dst &= ~src`: clears every bit of `dst` that is set in `src`. */
+static inline void sp_bitset_andnot(Sp_Bitset *dst, const Sp_Bitset *src) {
+    const size_t n = dst->bits.count < src->bits.count ? dst->bits.count : src->bits.count;
+    uint64_t *d = dst->bits.data;
+    const uint64_t *s = src->bits.data;
+    for (size_t i = 0; i < n; ++i) {
+        d[i] &= ~s[i];
+    }
+}
+
+static inline void sp_bitset_free(Sp_Bitset *bitset) {
+    sp_da_free(&bitset->bits);
+}
+
+/*
+ * Blocked Bloom filter over an `Sp_Bitset`: every key maps to one 64-byte, cache-line-aligned block and sets `k`
+ * bits inside it, so a lookup costs a single cache miss. Keys are given as 64-bit hashes; the high half selects
+ * the block and every in-block bit is the top 9 bits of a multiply-add remix of the whole hash, so the probes
+ * stay independent at low false-positive rates. Pass the hash the table probe uses anyway
+ * (`sp_ht_hash_key(&ht, &key)`, or the `hash` of an `Sp_Hashed_View`) to hash a key only once.
+ *
+ * Insert-only: bits cannot be cleared without also clearing other keys. Filters of the same geometry (built with
+ * the same `expected` and `fpr`) can be merged.
+ */
+typedef struct {
+    Sp_Bitset bits;
+    size_t offset; // first word of the aligned block array within `bits`
+    size_t blocks;
+    uint32_t k; // bits set per key
+} Sp_Bloom;
+
+#define SP_BLOOM_BLOCK_WORDS 8
+#define SP_BLOOM_BLOCK_BITS (SP_BLOOM_BLOCK_WORDS * SP_BITSET_WORD_BITS)
+#define SP_BLOOM_MAX_K 16
+
+/* log2(x) for x > 0 without libm: exponent plus an atanh series for the mantissa, accurate to ~1e-7. */
+static inline double __sp_bloom_log2(double x) {
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    const int exponent = (int) ((bits >> 52) & 0x7FF) - 1023;
+    bits = (bits & 0x000FFFFFFFFFFFFFull) | 0x3FF0000000000000ull;
+    double m;
+    memcpy(&m, &bits, sizeof(m));
+    const double t = (m - 1) / (m + 1), t2 = t * t;
+    const double ln_m = 2 * t * (1 + t2 * (1.0 / 3 + t2 * (1.0 / 5 + t2 * (1.0 / 7 + t2 * (1.0 / 9)))));
+    return exponent + ln_m * 1.4426950408889634;
+}
+
+/* Sizes an empty filter for `expected` keys at a false-positive rate of about `fpr`, in (0, 1). */
+static inline void sp_bloom_init(Sp_Bloom *bloom, size_t expected, double fpr) {
+    assert(bloom);
+    assert(fpr > 0 && fpr < 1);
+
+    // m = -n ln(p) / ln(2)^2 and k = -log2(p). Blocking skews the load across blocks, which costs accuracy at the
+    // same size, more so at low rates (and k is capped): grow m by ~1.8% per halving of p to make up for it.
+    const double log2_fpr = -__sp_bloom_log2(fpr);
+    const double bits_per_key = log2_fpr * 1.4426950408889634 * (1 + log2_fpr / 55);
+    const double nbits = (double) (expected ? expected : 1) * bits_per_key;
+    const double k = log2_fpr + 0.5;
+
+    bloom->blocks = (size_t) (nbits / SP_BLOOM_BLOCK_BITS) + 1;
+    assert(bloom->blocks <= UINT32_MAX);
+    bloom->k = k < 1 ? 1 : k > SP_BLOOM_MAX_K ? SP_BLOOM_MAX_K : (uint32_t) k;
+
+    // One spare block's worth of words lets the block array start on a cache line.
+    sp_bitset_free(&bloom->bits);
+    sp_da_resize(&bloom->bits.bits, (bloom->blocks + 1) * SP_BLOOM_BLOCK_WORDS);
+    const size_t misalignment = (uintptr_t) bloom->bits.bits.data % (SP_BLOOM_BLOCK_WORDS * sizeof(uint64_t));
+    bloom->offset = misalignment ? SP_BLOOM_BLOCK_WORDS - misalignment / sizeof(uint64_t) : 0;
+}
+
+static inline uint64_t *__sp_bloom_block(const Sp_Bloom *bloom, uint64_t hash) {
+    assert(bloom->blocks > 0 && "sp_bloom_init() the filter first");
+    const size_t block = (size_t) (((hash >> 32) * bloom->blocks) >> 32);
+    return bloom->bits.bits.data + bloom->offset + block * SP_BLOOM_BLOCK_WORDS;
+}
+
+/* Steps the probe state through a 64-bit multiply-add and returns its top 9 bits, a bit index in 0..511. */
+static inline uint32_t __sp_bloom_next_bit(uint64_t *h) {
+    *h = *h * 0x9E3779B97F4A7C15ull + 0xD1B54A32D192ED03ull;
+    return (uint32_t) (*h >> 55);
+}
+
+static inline void sp_bloom_add_hash(Sp_Bloom *bloom, uint64_t hash) {
+    uint64_t *block = __sp_bloom_block(bloom, hash);
+    uint64_t h = hash;
+    for (uint32_t i = 0; i < bloom->k; ++i) {
+        const uint32_t bit = __sp_bloom_next_bit(&h);
+        block[bit / SP_BITSET_WORD_BITS] |= sp_bitset_get_bitmask(bit);
+    }
+}
+
+/* 0 if the key was never added; 1 if it probably was. */
+static inline int sp_bloom_contains_hash(const Sp_Bloom *bloom, uint64_t hash) {
+    const uint64_t *block = __sp_bloom_block(bloom, hash);
+    uint64_t h = hash;
+    uint64_t missing = 0;
+    for (uint32_t i = 0; i < bloom->k; ++i) {
+        const uint32_t bit = __sp_bloom_next_bit(&h);
+        missing |= ~block[bit / SP_BITSET_WORD_BITS] & sp_bitset_get_bitmask(bit);
+    }
+    return missing == 0;
+}
 
-#define FNV_PRIME_32 16777619
-#define FNV_OFFSET_BASIS_32 2166136261
+#define sp_bloom_add_bytes(bloom, data, bytes) sp_bloom_add_hash((bloom), sp_hash_bytes((data), (bytes), 0))
+#define sp_bloom_contains_bytes(bloom, data, bytes) sp_bloom_contains_hash((bloom), sp_hash_bytes((data), (bytes), 0))
 
-static inline uint32_t hash_fnv(const char *const *data, const size_t bytes) {
-    assert(data);
+/* `dst |= src`: afterwards `dst` answers for the keys of both. Both must share their geometry. */
+static inline void sp_bloom_merge(Sp_Bloom *dst, const Sp_Bloom *src) {
+    assert(dst->blocks == src->blocks && dst->k == src->k && "merged filters must be built with the same sizing");
+    uint64_t *d = dst->bits.bits.data + dst->offset;
+    const uint64_t *s = src->bits.bits.data + src->offset;
+    for (size_t i = 0; i < dst->blocks * SP_BLOOM_BLOCK_WORDS; ++i) {
+        d[i] |= s[i];
+    }
+}
 
-    uint32_t hash = FNV_OFFSET_BASIS_32;
+static inline void sp_bloom_free(Sp_Bloom *bloom) {
+    sp_bitset_free(&bloom->bits);
+    bloom->offset = 0;
+    bloom->blocks = 0;
+}
 
-    for (size_t i = 0; i < bytes; ++i) {
-        hash = (hash ^ (unsigned) (*data)[i]) * FNV_PRIME_32;
+/*
+ * Compressed bitmap over 32-bit values, after Roaring (Lemire et al.). Values are partitioned by their high 16
+ * bits into containers, each holding the low 16 bits of its members as whichever fits best:
+ *  - a sorted array of up to `SP_ROARING_ARRAY_MAX` values,
+ *  - a 65536-bit bitmap once the array would be larger than the bitmap,
+ *  - sorted (start, length - 1) runs, after `sp_roaring_optimize()` finds them smaller.
+ * Memory is therefore proportional to the number of members rather than to the largest one.
+ *
+ * Zero-initialize before use. Run containers are expanded back to an array or bitmap when modified.
+ */
+#define SP_ROARING_ARRAY_MAX 4096
+#define SP_ROARING_BITMAP_WORDS 1024
+
+typedef enum {
+    SP_ROARING_ARRAY,
+    SP_ROARING_BITMAP,
+    SP_ROARING_RUN,
+} Sp_Roaring_Kind;
+
+typedef struct {
+    uint16_t key; // high 16 bits shared by the members
+    uint8_t kind; // Sp_Roaring_Kind
+    uint32_t cardinality;
+    uint32_t count;    // array values or runs in use
+    uint32_t capacity; // array values or runs allocated
+    void *data;        // uint16_t values, uint64_t[SP_ROARING_BITMAP_WORDS] words or uint16_t (start, length - 1) pairs
+} Sp_Roaring_Container;
+
+typedef struct {
+    Sp_Dynamic_Array(Sp_Roaring_Container) containers; // sorted by key
+    const Sp_Allocator *allocator;
+} Sp_Roaring;
+
+static inline size_t __sp_roaring_container_bytes(const Sp_Roaring_Container *c) {
+    switch (c->kind) {
+        case SP_ROARING_ARRAY:
+            return c->capacity * sizeof(uint16_t);
+        case SP_ROARING_BITMAP:
+            return SP_ROARING_BITMAP_WORDS * sizeof(uint64_t);
+        default:
+            return c->capacity * 2 * sizeof(uint16_t);
     }
+}
 
-    return hash;
+static inline void __sp_roaring_container_free(const Sp_Roaring *r, Sp_Roaring_Container *c) {
+    sp_free(r->allocator, c->data, __sp_roaring_container_bytes(c));
+    c->data = NULL;
 }
 
-static inline uint32_t sp_cstr_hash_fnv(const char *const *cstr) {
-    assert(cstr);
-    return hash_fnv(cstr, strlen(*cstr));
+/* Replaces the storage of `c` with `data` of the given kind and size. */
+static inline void __sp_roaring_container_replace(const Sp_Roaring *r, Sp_Roaring_Container *c, uint8_t kind,
+                                                  void *data, uint32_t count, uint32_t capacity) {
+    __sp_roaring_container_free(r, c);
+    c->kind = kind;
+    c->data = data;
+    c->count = count;
+    c->capacity = capacity;
 }
 
-static inline uint32_t sp_sv_hash_fnv(const Sp_String_View *slice) {
-    assert(slice);
-    return hash_fnv(&slice->ptr, slice->count);
+/* First index in the sorted `values[0, n)` holding a value >= `v`. */
+static inline uint32_t __sp_roaring_lower_bound(const uint16_t *values, uint32_t n, uint16_t v) {
+    uint32_t lo = 0;
+    while (n > 0) {
+        const uint32_t half = n / 2;
+        if (values[lo + half] < v) {
+            lo += half + 1;
+            n -= half + 1;
+        } else {
+            n = half;
+        }
+    }
+    return lo;
 }
 
-static inline uint32_t sp_ht_streq(const char *const *s1, const char *const *s2) { return (uint32_t) !strcmp(*s1, *s2); }
+/* Index of the container with `key`, or where it would be inserted; `*found` tells which. */
+static inline size_t __sp_roaring_find(const Sp_Roaring *r, uint16_t key, int *found) {
+    size_t lo = 0, n = r->containers.count;
+    while (n > 0) {
+        const size_t half = n / 2;
+        if (r->containers.data[lo + half].key < key) {
+            lo += half + 1;
+            n -= half + 1;
+        } else {
+            n = half;
+        }
+    }
+    *found = lo < r->containers.count && r->containers.data[lo].key == key;
+    return lo;
+}
 
-/*
- * Hash table implementation with closed addressing collision resolution, where buckets are backed by Sp_Dynamic_Array.
- *
- * Re-hashes entire table at 2x capacity on insertion when load factor reaches the ratio as defined by
- * `SP_HT_LOAD_CAPACITY` (default = 0.9).
- */
-// TODO: strlen is undefined for non string types, meaning only const char* keys are supported as of right now
-#define Sp_Hash_Table(K, T)                        \
-    struct {                                       \
-        Sp_Dynamic_Array(Sp_Dynamic_Array(struct { \
-            K key;                                 \
-            T value;                               \
-        })) table;                                 \
-        size_t count;                              \
-        uint32_t (*hash)(K const *);               \
-        uint32_t (*equal)(K const *, K const *);   \
+static inline int __sp_roaring_container_contains(const Sp_Roaring_Container *c, uint16_t low) {
+    switch (c->kind) {
+        case SP_ROARING_ARRAY: {
+            const uint16_t *values = c->data;
+            const uint32_t pos = __sp_roaring_lower_bound(values, c->count, low);
+            return pos < c->count && values[pos] == low;
+        }
+        case SP_ROARING_BITMAP:
+            return (int) ((((const uint64_t *) c->data)[low >> 6] >> (low & 63)) & 1);
+        default: {
+            // Last run starting at or before `low`
+            const uint16_t *runs = c->data;
+            uint32_t lo = 0, n = c->count;
+            while (n > 0) {
+                const uint32_t half = n / 2;
+                if (runs[2 * (lo + half)] <= low) {
+                    lo += half + 1;
+                    n -= half + 1;
+                } else {
+                    n = half;
+                }
+            }
+            return lo > 0 && low - runs[2 * (lo - 1)] <= runs[2 * (lo - 1) + 1];
+        }
     }
+}
 
-#define sp_ht_node_t(ht) __typeof__(*(ht)->table.data->data)
-#define sp_ht_key_type(ht) __typeof__((ht)->table.data->data->key)
-#define sp_ht_value_type(ht) __typeof__((ht)->table.data->data->value)
+static inline void __sp_roaring_bitmap_set_range(uint64_t *words, uint32_t begin, uint32_t end) {
+    for (uint32_t i = begin; i < end;) {
+        const uint32_t bit = i & 63, n = end - i < 64 - bit ? end - i : 64 - bit;
+        words[i >> 6] |= (n == 64 ? ~(uint64_t) 0 : (((uint64_t) 1 << n) - 1) << bit);
+        i += n;
+    }
+}
 
-#define SP_HT_LOAD_CAPACITY 0.75
-#define SP_HT_INIT_CAP 8
+static inline void __sp_roaring_bitmap_clear_range(uint64_t *words, uint32_t begin, uint32_t end) {
+    for (uint32_t i = begin; i < end;) {
+        const uint32_t bit = i & 63, n = end - i < 64 - bit ? end - i : 64 - bit;
+        words[i >> 6] &= ~(n == 64 ? ~(uint64_t) 0 : (((uint64_t) 1 << n) - 1) << bit);
+        i += n;
+    }
+}
 
-#define sp_ht_reserve(ht, __expected__)                                                                        \
-    do {                                                                                                       \
-        const size_t expected = (__expected__);                                                                \
-        if (!(ht)->hash) {                                                                                     \
-            (ht)->hash = _Generic((ht)->table.data->data->key,                                                 \
-                const char *: &sp_cstr_hash_fnv,                                                               \
-                Sp_String_View: &sp_sv_hash_fnv,                                                               \
-                default: NULL);                                                                                \
-        }                                                                                                      \
-        if (!(ht)->equal) {                                                                                    \
-            (ht)->equal = _Generic((ht)->table.data->data->key,                                                \
-                const char *: &sp_ht_streq,                                                                    \
-                Sp_String_View: &sp_sv_eq,                                                                     \
-                default: NULL);                                                                                \
-        }                                                                                                      \
-        if ((ht)->table.capacity == 0) {                                                                       \
-            sp_da_resize(&(ht)->table, expected < SP_HT_INIT_CAP ? SP_HT_INIT_CAP : expected);                 \
-        } else if ((ht)->count > 0) {                                                                          \
-            __typeof__((ht)->table) old_table = (ht)->table;                                                   \
-            (ht)->table = (__typeof__((ht)->table)) {0};                                                       \
-            sp_da_resize(&(ht)->table, expected);                                                              \
-            for (size_t macro_var(i) = 0; macro_var(i) < old_table.count; ++macro_var(i)) {                    \
-                for (size_t macro_var(j) = 0; macro_var(j) < sp_da_get(&old_table, macro_var(i)).count;        \
-                     ++macro_var(j)) {                                                                         \
-                    sp_da_push(                                                                                \
-                        &(ht)->table.data[(ht)->hash(&(old_table.data[macro_var(i)].data[macro_var(j)].key)) % \
-                                          (ht)->table.capacity],                                               \
-                        old_table.data[macro_var(i)].data[macro_var(j)]);                                      \
-                }                                                                                              \
-                sp_da_free(&(sp_da_get(&old_table, macro_var(i))));                                            \
-            }                                                                                                  \
-            sp_da_free(&old_table);                                                                            \
-        }                                                                                                      \
-    } while (0)
+static inline uint32_t __sp_roaring_bitmap_cardinality(const uint64_t *words) {
+    uint32_t cardinality = 0;
+    for (size_t i = 0; i < SP_ROARING_BITMAP_WORDS; ++i) {
+        cardinality += (uint32_t) __builtin_popcountll(words[i]);
+    }
+    return cardinality;
+}
 
-/* Points `sp_ht_node_t_ptr` to the `sp_ht_node_t` instance containing the key, or NULL if not found.
- * This pointer can be invalidated by any subsequent instructions to the `Sp_Hash_Table` object. */
-#define sp_ht_get(ht, __key__, sp_ht_node_t_ptr)                                                        \
-    do {                                                                                                \
-        if ((sp_ht_node_t_ptr)) {                                                                       \
-            *((sp_ht_node_t_ptr)) = NULL;                                                               \
-            if (!(ht)->hash) break;                                                                     \
-            size_t macro_var(idx) = (ht)->hash(&(__key__)) % (ht)->table.capacity;                      \
-            for (size_t macro_var(i) = 0; macro_var(i) < sp_da_get(&(ht)->table, macro_var(idx)).count; \
-                 ++macro_var(i)) {                                                                      \
-                if (!(ht)->equal(&((__key__)),                                                          \
-                                 &(ht)->table.data[macro_var(idx)].data[macro_var(i)].key)) {           \
-                    continue;                                                                           \
-                } else {                                                                                \
-                    *((sp_ht_node_t_ptr)) = &(ht)->table.data[macro_var(idx)].data[macro_var(i)];       \
-                }                                                                                       \
-            }                                                                                           \
-        }                                                                                               \
-    } while (0)
-
-#define sp_ht_insert(ht, __key__, __value__)                                                                      \
-    do {                                                                                                          \
-        if ((ht)->table.capacity == 0) {                                                                          \
-            sp_ht_reserve((ht), SP_HT_INIT_CAP);                                                                  \
-        } else if ((double) (ht)->count > (SP_HT_LOAD_CAPACITY * (double) (ht)->table.capacity)) {                \
-            sp_ht_reserve((ht), (ht)->table.capacity * 2);                                                        \
-        }                                                                                                         \
-        size_t macro_var(idx) = (ht)->hash(&(__key__)) % (ht)->table.capacity;                                    \
-        for (size_t macro_var(i) = 0; macro_var(i) < (ht)->table.data[macro_var(idx)].count; ++macro_var(i)) {    \
-            if ((ht)->equal(&(__key__), &(ht)->table.data[macro_var(idx)].data[macro_var(i)].key)) {              \
-                (ht)->table.data[macro_var(idx)].data[macro_var(i)].value = __value__;                            \
-                goto macro_var(sp_ht_insert_end);                                                                 \
-            }                                                                                                     \
-        }                                                                                                         \
-        sp_da_push(&(ht)->table.data[macro_var(idx)], ((sp_ht_node_t(ht)) {.key = __key__, .value = __value__})); \
-        ++(ht)->count;                                                                                            \
-        macro_var(sp_ht_insert_end) : break;                                                                      \
-    } while (0)
+/* Converts an array or run container to a bitmap. */
+static inline void __sp_roaring_to_bitmap(const Sp_Roaring *r, Sp_Roaring_Container *c) {
+    uint64_t *words = sp_alloc_zeroed(r->allocator, SP_ROARING_BITMAP_WORDS, sizeof(uint64_t));
+    const uint16_t *values = c->data;
+    if (c->kind == SP_ROARING_ARRAY) {
+        for (uint32_t i = 0; i < c->count; ++i) {
+            words[values[i] >> 6] |= (uint64_t) 1 << (values[i] & 63);
+        }
+    } else {
+        for (uint32_t i = 0; i < c->count; ++i) {
+            __sp_roaring_bitmap_set_range(words, values[2 * i], (uint32_t) values[2 * i] + values[2 * i + 1] + 1);
+        }
+    }
+    __sp_roaring_container_replace(r, c, SP_ROARING_BITMAP, words, 0, 0);
+}
 
-#define sp_ht_free(ht)                                                                    \
-    do {                                                                                  \
-        for (size_t macro_var(i) = 0; macro_var(i) < (ht)->table.count; ++macro_var(i)) { \
-            sp_da_free(&(ht)->table.data[macro_var(i)]);                                  \
-        }                                                                                 \
-        sp_da_free(&(ht)->table);                                                         \
-        memset((ht), 0, sizeof(*(ht)));                                                   \
-    } while (0)
+/* Converts a bitmap or run container of at most `SP_ROARING_ARRAY_MAX` members to an array. */
+static inline void __sp_roaring_to_array(const Sp_Roaring *r, Sp_Roaring_Container *c) {
+    const uint32_t capacity = c->cardinality > 0 ? c->cardinality : 1;
+    uint16_t *values = sp_alloc(r->allocator, capacity * sizeof(uint16_t));
+    uint32_t n = 0;
+    if (c->kind == SP_ROARING_BITMAP) {
+        const uint64_t *words = c->data;
+        for (uint32_t i = 0; i < SP_ROARING_BITMAP_WORDS; ++i) {
+            for (uint64_t w = words[i]; w; w &= w - 1) {
+                values[n++] = (uint16_t) (i * 64 + (uint32_t) __builtin_ctzll(w));
+            }
+        }
+    } else {
+        const uint16_t *runs = c->data;
+        for (uint32_t i = 0; i < c->count; ++i) {
+            for (uint32_t v = runs[2 * i]; v <= (uint32_t) runs[2 * i] + runs[2 * i + 1]; ++v) {
+                values[n++] = (uint16_t) v;
+            }
+        }
+    }
+    __sp_roaring_container_replace(r, c, SP_ROARING_ARRAY, values, n, capacity);
+}
 
-typedef struct {
-    Sp_Dynamic_Array(uint8_t) bits;
-} Sp_Bitset;
+/* Brings `c` back to the array or bitmap kind that its cardinality calls for. */
+static inline void __sp_roaring_normalize(const Sp_Roaring *r, Sp_Roaring_Container *c) {
+    if (c->kind == SP_ROARING_RUN) {
+        if (c->cardinality <= SP_ROARING_ARRAY_MAX) {
+            __sp_roaring_to_array(r, c);
+        } else {
+            __sp_roaring_to_bitmap(r, c);
+        }
+    } else if (c->kind == SP_ROARING_BITMAP && c->cardinality <= SP_ROARING_ARRAY_MAX) {
+        __sp_roaring_to_array(r, c);
+    } else if (c->kind == SP_ROARING_ARRAY && c->cardinality > SP_ROARING_ARRAY_MAX) {
+        __sp_roaring_to_bitmap(r, c);
+    }
+}
 
-static inline uint8_t sp_bitset_get_bitmask(size_t idx) {
-    switch (idx % CHAR_BIT) {
-        case 0:
-            return 0x80;
-        case 1:
-            return 0x40;
-        case 2:
-            return 0x20;
-        case 3:
-            return 0x10;
-        case 4:
-            return 0x08;
-        case 5:
-            return 0x04;
-        case 6:
-            return 0x02;
-        case 7:
-            return 0x01;
-        default:
-            sp_unreachable();
+/* Whether `value` is in the set. */
+static inline int sp_roaring_contains(const Sp_Roaring *r, uint32_t value) {
+    int found;
+    const size_t idx = __sp_roaring_find(r, (uint16_t) (value >> 16), &found);
+    return found && __sp_roaring_container_contains(&r->containers.data[idx], (uint16_t) value);
+}
+
+/* Adds `value`; returns whether it was absent. */
+static inline int sp_roaring_add(Sp_Roaring *r, uint32_t value) {
+    const uint16_t key = (uint16_t) (value >> 16), low = (uint16_t) value;
+    int found;
+    const size_t idx = __sp_roaring_find(r, key, &found);
+    if (!found) {
+        r->containers.allocator = r->allocator;
+        sp_da_reserve(&r->containers, r->containers.count + 1);
+        memmove(r->containers.data + idx + 1, r->containers.data + idx,
+                (r->containers.count - idx) * sizeof(*r->containers.data));
+        r->containers.data[idx] = (Sp_Roaring_Container) {.key = key, .kind = SP_ROARING_ARRAY};
+        ++r->containers.count;
+    }
+
+    Sp_Roaring_Container *c = &r->containers.data[idx];
+    if (c->kind == SP_ROARING_RUN) {
+        if (__sp_roaring_container_contains(c, low)) {
+            return 0;
+        }
+        __sp_roaring_normalize(r, c);
     }
+
+    if (c->kind == SP_ROARING_ARRAY) {
+        uint16_t *values = c->data;
+        const uint32_t pos = __sp_roaring_lower_bound(values, c->count, low);
+        if (pos < c->count && values[pos] == low) {
+            return 0;
+        }
+        if (c->count < SP_ROARING_ARRAY_MAX) {
+            if (c->count == c->capacity) {
+                const uint32_t capacity = c->capacity ? 2 * c->capacity : 4;
+                c->data =
+                    sp_realloc(r->allocator, c->data, c->capacity * sizeof(uint16_t), capacity * sizeof(uint16_t));
+                c->capacity = capacity;
+                values = c->data;
+            }
+            memmove(values + pos + 1, values + pos, (c->count - pos) * sizeof(uint16_t));
+            values[pos] = low;
+            ++c->count;
+            ++c->cardinality;
+            return 1;
+        }
+        __sp_roaring_to_bitmap(r, c);
+    }
+
+    uint64_t *word = &((uint64_t *) c->data)[low >> 6];
+    const uint64_t mask = (uint64_t) 1 << (low & 63);
+    if (*word & mask) {
+        return 0;
+    }
+    *word |= mask;
+    ++c->cardinality;
+    return 1;
 }
 
-/* Logical ORs all other bits except for desired bit with 0 (keep constant).
- * The selected bit will be ORed with 1, and thus enabled. */
-static inline void sp_bitset_set(Sp_Bitset *bitset, size_t idx) {
-    if (bitset->bits.count < (idx / CHAR_BIT) + 1) sp_da_resize(&bitset->bits, (idx / CHAR_BIT) + 1);
-    bitset->bits.data[idx / CHAR_BIT] |= sp_bitset_get_bitmask(idx);
+/* Removes `value`; returns whether it was present. */
+static inline int sp_roaring_remove(Sp_Roaring *r, uint32_t value) {
+    const uint16_t low = (uint16_t) value;
+    int found;
+    const size_t idx = __sp_roaring_find(r, (uint16_t) (value >> 16), &found);
+    if (!found || !__sp_roaring_container_contains(&r->containers.data[idx], low)) {
+        return 0;
+    }
+
+    Sp_Roaring_Container *c = &r->containers.data[idx];
+    if (c->kind == SP_ROARING_RUN) {
+        __sp_roaring_normalize(r, c);
+    }
+    --c->cardinality;
+    if (c->kind == SP_ROARING_ARRAY) {
+        uint16_t *values = c->data;
+        const uint32_t pos = __sp_roaring_lower_bound(values, c->count, low);
+        memmove(values + pos, values + pos + 1, (c->count - pos - 1) * sizeof(uint16_t));
+        --c->count;
+    } else {
+        ((uint64_t *) c->data)[low >> 6] &= ~((uint64_t) 1 << (low & 63));
+        __sp_roaring_normalize(r, c);
+    }
+
+    if (c->cardinality == 0) {
+        __sp_roaring_container_free(r, c);
+        memmove(c, c + 1, (r->containers.count - idx - 1) * sizeof(*c));
+        --r->containers.count;
+    }
+    return 1;
 }
 
-/* Logical ANDs all other bits except for desired bit with 1 (keep constant).
- * The selected bit will be ANDed with 0, and thus disabled. */
-static inline void sp_bitset_reset(Sp_Bitset *bitset, size_t idx) {
-    if (idx / CHAR_BIT >= bitset->bits.count) {
+static inline uint64_t sp_roaring_cardinality(const Sp_Roaring *r) {
+    uint64_t cardinality = 0;
+    for (size_t i = 0; i < r->containers.count; ++i) {
+        cardinality += r->containers.data[i].cardinality;
+    }
+    return cardinality;
+}
+
+/* `dst` container &= `src` container, both with the same key. */
+static inline void __sp_roaring_container_and(const Sp_Roaring *r, Sp_Roaring_Container *dst,
+                                              const Sp_Roaring_Container *src) {
+    if (dst->kind == SP_ROARING_RUN) {
+        __sp_roaring_normalize(r, dst);
+    }
+
+    if (dst->kind == SP_ROARING_ARRAY && src->kind == SP_ROARING_ARRAY) {
+        // Linear merge of the two sorted arrays
+        uint16_t *values = dst->data;
+        const uint16_t *src_values = src->data;
+        uint32_t i = 0, j = 0, n = 0;
+        while (i < dst->count && j < src->count) {
+            const uint16_t x = values[i], y = src_values[j];
+            values[n] = x;
+            n += x == y;
+            i += x <= y;
+            j += y <= x;
+        }
+        dst->count = dst->cardinality = n;
         return;
     }
-    bitset->bits.data[idx / CHAR_BIT] &= (~sp_bitset_get_bitmask(idx));
+
+    if (dst->kind == SP_ROARING_ARRAY) {
+        uint16_t *values = dst->data;
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < dst->count; ++i) {
+            if (__sp_roaring_container_contains(src, values[i])) {
+                values[n++] = values[i];
+            }
+        }
+        dst->count = dst->cardinality = n;
+        return;
+    }
+
+    uint64_t *words = dst->data;
+    if (src->kind == SP_ROARING_ARRAY) {
+        // At most as many members as the array: keep the array's values found in the bitmap.
+        uint16_t *values = sp_alloc(r->allocator, (src->count ? src->count : 1) * sizeof(uint16_t));
+        const uint16_t *src_values = src->data;
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < src->count; ++i) {
+            values[n] = src_values[i];
+            n += (uint32_t) ((words[src_values[i] >> 6] >> (src_values[i] & 63)) & 1);
+        }
+        __sp_roaring_container_replace(r, dst, SP_ROARING_ARRAY, values, n, src->count ? src->count : 1);
+        dst->cardinality = n;
+        return;
+    }
+
+    if (src->kind == SP_ROARING_BITMAP) {
+        const uint64_t *src_words = src->data;
+        for (size_t i = 0; i < SP_ROARING_BITMAP_WORDS; ++i) {
+            words[i] &= src_words[i];
+        }
+    } else {
+        // Clear the gaps between the runs
+        const uint16_t *runs = src->data;
+        uint32_t next = 0;
+        for (uint32_t i = 0; i < src->count; ++i) {
+            __sp_roaring_bitmap_clear_range(words, next, runs[2 * i]);
+            next = (uint32_t) runs[2 * i] + runs[2 * i + 1] + 1;
+        }
+        __sp_roaring_bitmap_clear_range(words, next, 1u << 16);
+    }
+    dst->cardinality = __sp_roaring_bitmap_cardinality(words);
+    __sp_roaring_normalize(r, dst);
 }
 
-/* Logical ANDs all other bits except for desired bit with 0 (disable).
- * The selected bit will remain as is, and thus will return as a boolean.
- * This is immutable. */
-static inline int sp_bitset_check(const Sp_Bitset *bitset, size_t idx) {
-    if (idx / CHAR_BIT >= bitset->bits.count) {
-        return 0;
+/* `dst` container |= `src` container, both with the same key. */
+static inline void __sp_roaring_container_or(const Sp_Roaring *r, Sp_Roaring_Container *dst,
+                                             const Sp_Roaring_Container *src) {
+    if (dst->kind == SP_ROARING_RUN) {
+        __sp_roaring_normalize(r, dst);
+    }
+
+    if (dst->kind == SP_ROARING_ARRAY && src->kind == SP_ROARING_ARRAY &&
+        dst->count + src->count <= SP_ROARING_ARRAY_MAX) {
+        // Merge the two sorted arrays
+        const uint16_t *a = dst->data, *b = src->data;
+        const uint32_t capacity = dst->count + src->count;
+        uint16_t *values = sp_alloc(r->allocator, capacity * sizeof(uint16_t));
+        uint32_t i = 0, j = 0, n = 0;
+        while (i < dst->count && j < src->count) {
+            const uint16_t x = a[i] < b[j] ? a[i] : b[j];
+            i += a[i] == x;
+            j += b[j] == x;
+            values[n++] = x;
+        }
+        while (i < dst->count) {
+            values[n++] = a[i++];
+        }
+        while (j < src->count) {
+            values[n++] = b[j++];
+        }
+        __sp_roaring_container_replace(r, dst, SP_ROARING_ARRAY, values, n, capacity);
+        dst->cardinality = n;
+        return;
+    }
+
+    if (dst->kind == SP_ROARING_ARRAY) {
+        __sp_roaring_to_bitmap(r, dst);
+    }
+    uint64_t *words = dst->data;
+    if (src->kind == SP_ROARING_ARRAY) {
+        const uint16_t *values = src->data;
+        for (uint32_t i = 0; i < src->count; ++i) {
+            words[values[i] >> 6] |= (uint64_t) 1 << (values[i] & 63);
+        }
+    } else if (src->kind == SP_ROARING_BITMAP) {
+        const uint64_t *src_words = src->data;
+        for (size_t i = 0; i < SP_ROARING_BITMAP_WORDS; ++i) {
+            words[i] |= src_words[i];
+        }
+    } else {
+        const uint16_t *runs = src->data;
+        for (uint32_t i = 0; i < src->count; ++i) {
+            __sp_roaring_bitmap_set_range(words, runs[2 * i], (uint32_t) runs[2 * i] + runs[2 * i + 1] + 1);
+        }
     }
+    dst->cardinality = __sp_roaring_bitmap_cardinality(words);
+    __sp_roaring_normalize(r, dst);
+}
 
-    return bitset->bits.data[idx / CHAR_BIT] & sp_bitset_get_bitmask(idx);
+/* Deep copy of `src` into a fresh container of `r`. */
+static inline Sp_Roaring_Container __sp_roaring_container_clone(const Sp_Roaring *r, const Sp_Roaring_Container *src) {
+    Sp_Roaring_Container c = *src;
+    const size_t bytes = __sp_roaring_container_bytes(src);
+    c.data = sp_alloc(r->allocator, bytes);
+    memcpy(c.data, src->data, bytes);
+    return c;
 }
 
-static inline void sp_bitset_free(Sp_Bitset *bitset) {
-    sp_da_free(&bitset->bits);
+/* `dst &= src`. */
+static inline void sp_roaring_and(Sp_Roaring *dst, const Sp_Roaring *src) {
+    size_t n = 0, j = 0;
+    for (size_t i = 0; i < dst->containers.count; ++i) {
+        Sp_Roaring_Container *c = &dst->containers.data[i];
+        while (j < src->containers.count && src->containers.data[j].key < c->key) {
+            ++j;
+        }
+        if (j < src->containers.count && src->containers.data[j].key == c->key) {
+            __sp_roaring_container_and(dst, c, &src->containers.data[j]);
+        } else {
+            c->cardinality = 0;
+        }
+        if (c->cardinality == 0) {
+            __sp_roaring_container_free(dst, c);
+        } else {
+            dst->containers.data[n++] = *c;
+        }
+    }
+    dst->containers.count = n;
+}
+
+/* `dst |= src`. */
+static inline void sp_roaring_or(Sp_Roaring *dst, const Sp_Roaring *src) {
+    Sp_Dynamic_Array(Sp_Roaring_Container) merged = {.allocator = dst->allocator};
+    sp_da_reserve(&merged, dst->containers.count + src->containers.count);
+    size_t i = 0, j = 0;
+    while (i < dst->containers.count || j < src->containers.count) {
+        Sp_Roaring_Container *a = i < dst->containers.count ? &dst->containers.data[i] : NULL;
+        const Sp_Roaring_Container *b = j < src->containers.count ? &src->containers.data[j] : NULL;
+        if (a && (!b || a->key < b->key)) {
+            merged.data[merged.count++] = *a;
+            ++i;
+        } else if (!a || b->key < a->key) {
+            merged.data[merged.count++] = __sp_roaring_container_clone(dst, b);
+            ++j;
+        } else {
+            __sp_roaring_container_or(dst, a, b);
+            merged.data[merged.count++] = *a;
+            ++i;
+            ++j;
+        }
+    }
+    sp_da_free(&dst->containers);
+    dst->containers.data = merged.data;
+    dst->containers.count = merged.count;
+    dst->containers.capacity = merged.capacity;
+}
+
+/* Number of runs of consecutive members in `c`. */
+static inline uint32_t __sp_roaring_count_runs(const Sp_Roaring_Container *c) {
+    if (c->kind == SP_ROARING_RUN) {
+        return c->count;
+    }
+    uint32_t runs = 0;
+    if (c->kind == SP_ROARING_ARRAY) {
+        const uint16_t *values = c->data;
+        for (uint32_t i = 0; i < c->count; ++i) {
+            runs += i == 0 || values[i] != values[i - 1] + 1;
+        }
+    } else {
+        // A run starts at every set bit whose lower neighbour is clear
+        const uint64_t *words = c->data;
+        uint64_t carry = 0;
+        for (size_t i = 0; i < SP_ROARING_BITMAP_WORDS; ++i) {
+            runs += (uint32_t) __builtin_popcountll(words[i] & ~((words[i] << 1) | carry));
+            carry = words[i] >> 63;
+        }
+    }
+    return runs;
+}
+
+/* Re-encodes every container that is smaller as runs, e.g. after bulk loading dense ranges. */
+static inline void sp_roaring_optimize(Sp_Roaring *r) {
+    for (size_t i = 0; i < r->containers.count; ++i) {
+        Sp_Roaring_Container *c = &r->containers.data[i];
+        if (c->kind == SP_ROARING_RUN) {
+            continue;
+        }
+        const uint32_t runs = __sp_roaring_count_runs(c);
+        const size_t current =
+            c->kind == SP_ROARING_ARRAY ? c->count * sizeof(uint16_t) : __sp_roaring_container_bytes(c);
+        if (runs * 2 * sizeof(uint16_t) >= current) {
+            continue;
+        }
+
+        uint16_t *pairs = sp_alloc(r->allocator, runs * 2 * sizeof(uint16_t));
+        uint32_t n = 0;
+        int32_t prev = -2;
+        const uint16_t *values = c->data;
+        const uint64_t *words = c->data;
+        const uint32_t limit = c->kind == SP_ROARING_ARRAY ? c->count : SP_ROARING_BITMAP_WORDS;
+        for (uint32_t k = 0; k < limit; ++k) {
+            uint64_t w = c->kind == SP_ROARING_ARRAY ? 1 : words[k];
+            for (; w; w &= w - 1) {
+                const int32_t v =
+                    c->kind == SP_ROARING_ARRAY ? values[k] : (int32_t) (k * 64 + (uint32_t) __builtin_ctzll(w));
+                if (v == prev + 1) {
+                    ++pairs[2 * n - 1];
+                } else {
+                    pairs[2 * n] = (uint16_t) v;
+                    pairs[2 * n + 1] = 0;
+                    ++n;
+                }
+                prev = v;
+            }
+        }
+        __sp_roaring_container_replace(r, c, SP_ROARING_RUN, pairs, n, n);
+    }
+}
+
+/* Iterator over the members in ascending order:
+ *     Sp_Roaring_Iter it = sp_roaring_iter(&r);
+ *     uint32_t value;
+ *     while (sp_roaring_iter_next(&it, &value)) { ... } */
+typedef struct {
+    const Sp_Roaring *roaring;
+    size_t container;
+    uint32_t idx;    // array value, bitmap word or run index
+    uint32_t offset; // offset within the current run
+    uint64_t word;   // bits of bitmap word `idx` not visited yet
+} Sp_Roaring_Iter;
+
+static inline void __sp_roaring_iter_enter(Sp_Roaring_Iter *it) {
+    it->idx = 0;
+    it->offset = 0;
+    it->word = 0;
+    if (it->container < it->roaring->containers.count) {
+        const Sp_Roaring_Container *c = &it->roaring->containers.data[it->container];
+        if (c->kind == SP_ROARING_BITMAP) {
+            it->word = ((const uint64_t *) c->data)[0];
+        }
+    }
+}
+
+static inline Sp_Roaring_Iter sp_roaring_iter(const Sp_Roaring *r) {
+    Sp_Roaring_Iter it = {.roaring = r};
+    __sp_roaring_iter_enter(&it);
+    return it;
+}
+
+static inline int sp_roaring_iter_next(Sp_Roaring_Iter *it, uint32_t *value) {
+    while (it->container < it->roaring->containers.count) {
+        const Sp_Roaring_Container *c = &it->roaring->containers.data[it->container];
+        const uint32_t base = (uint32_t) c->key << 16;
+        if (c->kind == SP_ROARING_ARRAY) {
+            if (it->idx < c->count) {
+                *value = base | ((const uint16_t *) c->data)[it->idx++];
+                return 1;
+            }
+        } else if (c->kind == SP_ROARING_BITMAP) {
+            while (!it->word && ++it->idx < SP_ROARING_BITMAP_WORDS) {
+                it->word = ((const uint64_t *) c->data)[it->idx];
+            }
+            if (it->word) {
+                *value = base | (it->idx * 64 + (uint32_t) __builtin_ctzll(it->word));
+                it->word &= it->word - 1;
+                return 1;
+            }
+        } else if (it->idx < c->count) {
+            const uint16_t *runs = c->data;
+            *value = base | (runs[2 * it->idx] + it->offset);
+            if (it->offset++ == runs[2 * it->idx + 1]) {
+                ++it->idx;
+                it->offset = 0;
+            }
+            return 1;
+        }
+        ++it->container;
+        __sp_roaring_iter_enter(it);
+    }
+    return 0;
+}
+
+static inline void sp_roaring_free(Sp_Roaring *r) {
+    for (size_t i = 0; i < r->containers.count; ++i) {
+        __sp_roaring_container_free(r, &r->containers.data[i]);
+    }
+    r->containers.allocator = r->allocator;
+    sp_da_free(&r->containers);
 }
 
 #define sp_bt_capacity_from_height(height)   \
@@ -677,106 +3745,540 @@ static inline void sp_bitset_free(Sp_Bitset *bitset) {
 #define sp_bt_node_rchild_idx(idx) ((2 * (idx)) + 2)
 
 #define SP_BT_INIT_HEIGHT 3
-#define Sp_Heap(T)        \
-    struct {              \
-        T *data;          \
-        size_t count;     \
-        size_t height;    \
-        int (*cmp)(T, T); \
+/*
+ * Binary heap of `T`, or with `Sp_Heap_D(T, D)` a D-ary one: node `i` has children `D * i + 1` to `D * i + D`.
+ * Wider nodes make the heap shallower and put all the children compared at a level side by side in memory. The
+ * storage is placed so that `data[1]` starts a cache line: every child group then starts `D * i` elements past it,
+ * and never straddles two lines when `D * sizeof(T)` divides 64 (D = 4 for ints, pointers or 16-byte structs). Full
+ * groups of an even D >= 4 are scanned in pairs, so half of the compares do not wait on each other. The arity is
+ * part of the type, so index math compiles to shifts for powers of two.
+ *
+ * Ordering: `cmp(a, b)` returns whether `a` belongs above `b` (defaults to `sp_lesser_int_cmp` for `int`). Every
+ * operation also has a `_by` form taking `less` instead, the name of a function-like macro or function used as
+ * `less(a, b)` in place of `cmp`, which the compiler inlines instead of calling through the pointer:
+ *
+ *     #define timer_earlier(a, b) ((a).deadline < (b).deadline)
+ *     sp_heap_push_by(&timers, timer, timer_earlier);
+ *     sp_heap_pop_by(&timers, timer_earlier);
+ *
+ * Use one ordering per heap. Sifting moves a hole instead of swapping at every level.
+ */
+#define Sp_Heap_D(T, D)                                          \
+    struct {                                                     \
+        T *data;                                                 \
+        size_t count;                                            \
+        size_t height;                                           \
+        int (*cmp)(T, T);                                        \
+        const Sp_Allocator *allocator;                           \
+        size_t offset; /* bytes from the allocation to `data` */ \
+        char (*arity)[D]; /* never set: carries `D` only */      \
     }
+#define Sp_Heap(T) Sp_Heap_D(T, 2)
+
+#define sp_heap_arity(heap) sizeof(*(heap)->arity)
+#define sp_heap_parent_idx(heap, idx) (((idx) - 1) / sp_heap_arity(heap))
+#define sp_heap_first_child_idx(heap, idx) (sp_heap_arity(heap) * (idx) + 1)
 
 static inline int sp_lesser_int_cmp(const int a, const int b) {
     return a < b;
 }
 
-#define sp_bt_alloc(heap, __height__) \
-    __sp_bt_alloc((void **) &(heap)->data, &(heap)->height, __height__, sizeof(*(heap)->data))
-static inline void __sp_bt_alloc(void **data, size_t *height, size_t new_height, size_t type_size) {
-    if (!data || !height) {
+/* Bytes of a heap allocation: the 2^height - 1 elements plus a cache line of slack to align them. */
+#define sp_bt_alloc_size(height, type_size) (sp_bt_capacity_from_height(height) * (type_size) + SP_CACHE_LINE)
+
+/* Offset from `base` at which element 1 of an array of `type_size` elements starts a cache line. */
+static inline size_t __sp_bt_line_offset(const void *base, size_t type_size) {
+    return (SP_CACHE_LINE - ((uintptr_t) base + type_size) % SP_CACHE_LINE) % SP_CACHE_LINE;
+}
+
+#define sp_bt_alloc(heap, __height__)                                                                       \
+    __sp_bt_alloc((heap)->allocator, (void **) &(heap)->data, &(heap)->offset, &(heap)->height, __height__, \
+                  sizeof(*(heap)->data))
+static inline void __sp_bt_alloc(const Sp_Allocator *allocator, void **data, size_t *offset, size_t *height,
+                                 size_t new_height, size_t type_size) {
+    if (!data || !offset || !height) {
         return;
     }
 
-    const size_t new_capacity = sp_bt_capacity_from_height(new_height);
-
-    void *alloc = malloc(new_capacity * type_size);
-    assert(alloc);
+    char *base = *data ? (char *) *data - *offset : NULL;
+    const size_t old_size = *data ? sp_bt_alloc_size(*height, type_size) : 0;
+    base = sp_realloc(allocator, base, old_size, sp_bt_alloc_size(new_height, type_size));
 
-    if (*data) {
-        memcpy(alloc, *data, ((new_capacity < sp_bt_capacity_from_height(*height) ? new_capacity : sp_bt_capacity_from_height(*height)) * type_size));
-        free(*data);
+    // The block may have moved to a different position within a cache line.
+    const size_t new_offset = __sp_bt_line_offset(base, type_size);
+    if (*data && new_offset != *offset) {
+        memmove(base + new_offset, base + *offset, sp_bt_capacity_from_height(*height) * type_size);
     }
-    *data = alloc;
+
+    *data = base + new_offset;
+    *offset = new_offset;
     *height = new_height;
 }
 
-#define sp_heapify_up(heap, __idx__)                                                                   \
-    do {                                                                                               \
-        size_t idx = (__idx__);                                                                        \
-        while (idx != 0 && (heap)->cmp((heap)->data[idx], (heap)->data[sp_bt_node_parent_idx(idx)])) { \
-            sp_swap(&(heap)->data[idx], &(heap)->data[sp_bt_node_parent_idx(idx)]);                    \
-            idx = sp_bt_node_parent_idx(idx);                                                          \
-        }                                                                                              \
-    } while (0)
-
-#define sp_heapify(heap)                                                                               \
-    do {                                                                                               \
-        size_t parent_idx = 0;                                                                         \
-        while (parent_idx < (heap)->count) {                                                           \
-            size_t idx = parent_idx;                                                                   \
-            if (sp_bt_node_lchild_idx(parent_idx) < (heap)->count) {                                   \
-                idx = sp_bt_node_lchild_idx(parent_idx);                                               \
-            }                                                                                          \
-            if (sp_bt_node_rchild_idx(parent_idx) < (heap)->count) {                                   \
-                if ((heap)->cmp((heap)->data[sp_bt_node_rchild_idx(parent_idx)], (heap)->data[idx])) { \
-                    idx = sp_bt_node_rchild_idx(parent_idx);                                           \
-                }                                                                                      \
-            }                                                                                          \
-            if (parent_idx != idx && (heap)->cmp((heap)->data[idx], (heap)->data[parent_idx])) {       \
-                sp_swap(&(heap)->data[idx], &(heap)->data[parent_idx]);                                \
-                parent_idx = idx;                                                                      \
-            } else {                                                                                   \
-                break;                                                                                 \
-            }                                                                                          \
-        }                                                                                              \
+/* Grows the storage (2^height - 1 elements) to hold at least `__needed__` elements. */
+#define __sp_heap_reserve(heap, __needed__)                                                \
+    do {                                                                                   \
+        const size_t macro_var(hr_needed) = (__needed__);                                  \
+        size_t macro_var(hr_height) = (heap)->height ? (heap)->height : SP_BT_INIT_HEIGHT; \
+        while (sp_bt_capacity_from_height(macro_var(hr_height)) < macro_var(hr_needed)) {  \
+            ++macro_var(hr_height);                                                        \
+        }                                                                                  \
+        if (macro_var(hr_height) != (heap)->height) {                                      \
+            sp_bt_alloc((heap), macro_var(hr_height));                                     \
+        }                                                                                  \
+    } while (0)
+
+#define __sp_heap_default_cmp(heap)                                                        \
+    do {                                                                                   \
+        if (!(heap)->cmp) {                                                                \
+            (heap)->cmp = _Generic(*(heap)->data, int: &sp_lesser_int_cmp, default: NULL); \
+        }                                                                                  \
+    } while (0)
+
+/* Moves `__value__` up from the hole at `__idx__`, shifting parents down while it belongs above them. After every
+ * write to a slot `dst`, runs `track(heap, dst, src)`: `src` is the slot the element came from, or `SIZE_MAX` for
+ * `__value__` itself. */
+#define __sp_heap_sift_up_tracked(heap, __idx__, __value__, less, track)                        \
+    do {                                                                                        \
+        size_t macro_var(su_hole) = (__idx__);                                                  \
+        const __typeof__(*(heap)->data) macro_var(su_value) = (__value__);                      \
+        while (macro_var(su_hole) > 0) {                                                        \
+            const size_t macro_var(su_parent) = sp_heap_parent_idx((heap), macro_var(su_hole)); \
+            if (!less(macro_var(su_value), (heap)->data[macro_var(su_parent)])) {               \
+                break;                                                                          \
+            }                                                                                   \
+            (heap)->data[macro_var(su_hole)] = (heap)->data[macro_var(su_parent)];              \
+            track((heap), macro_var(su_hole), macro_var(su_parent));                            \
+            macro_var(su_hole) = macro_var(su_parent);                                          \
+        }                                                                                       \
+        (heap)->data[macro_var(su_hole)] = macro_var(su_value);                                 \
+        track((heap), macro_var(su_hole), SIZE_MAX);                                            \
+    } while (0)
+
+/* Moves `__value__` down from the hole at `__idx__`, shifting the first-ordered child up while it belongs above.
+ * Runs `track` like `__sp_heap_sift_up_tracked()`. */
+#define __sp_heap_sift_down_tracked(heap, __idx__, __value__, less, track)                                  \
+    do {                                                                                                    \
+        size_t macro_var(sd_hole) = (__idx__);                                                              \
+        const __typeof__(*(heap)->data) macro_var(sd_value) = (__value__);                                  \
+        for (;;) {                                                                                          \
+            const size_t macro_var(sd_first) = sp_heap_first_child_idx((heap), macro_var(sd_hole));         \
+            if (macro_var(sd_first) >= (heap)->count) {                                                     \
+                break;                                                                                      \
+            }                                                                                               \
+            const size_t macro_var(sd_end) = (heap)->count - macro_var(sd_first) < sp_heap_arity(heap)      \
+                                                 ? (heap)->count                                            \
+                                                 : macro_var(sd_first) + sp_heap_arity(heap);               \
+            size_t macro_var(sd_best) = macro_var(sd_first);                                                \
+            if (sp_heap_arity(heap) >= 4 && sp_heap_arity(heap) % 2 == 0 &&                                 \
+                macro_var(sd_end) - macro_var(sd_first) == sp_heap_arity(heap)) {                           \
+                /* Full group: pair the children off, then keep the best pair winner. */                    \
+                for (size_t macro_var(sd_c) = macro_var(sd_first); macro_var(sd_c) < macro_var(sd_end);     \
+                     macro_var(sd_c) += 2) {                                                                \
+                    const size_t macro_var(sd_pair) =                                                       \
+                        macro_var(sd_c) +                                                                   \
+                        (less((heap)->data[macro_var(sd_c) + 1], (heap)->data[macro_var(sd_c)]) ? 1 : 0);   \
+                    if (macro_var(sd_c) == macro_var(sd_first) ||                                           \
+                        less((heap)->data[macro_var(sd_pair)], (heap)->data[macro_var(sd_best)])) {         \
+                        macro_var(sd_best) = macro_var(sd_pair);                                            \
+                    }                                                                                       \
+                }                                                                                           \
+            } else {                                                                                        \
+                for (size_t macro_var(sd_c) = macro_var(sd_first) + 1; macro_var(sd_c) < macro_var(sd_end); \
+                     ++macro_var(sd_c)) {                                                                   \
+                    if (less((heap)->data[macro_var(sd_c)], (heap)->data[macro_var(sd_best)])) {            \
+                        macro_var(sd_best) = macro_var(sd_c);                                               \
+                    }                                                                                       \
+                }                                                                                           \
+            }                                                                                               \
+            if (!less((heap)->data[macro_var(sd_best)], macro_var(sd_value))) {                             \
+                break;                                                                                      \
+            }                                                                                               \
+            (heap)->data[macro_var(sd_hole)] = (heap)->data[macro_var(sd_best)];                            \
+            track((heap), macro_var(sd_hole), macro_var(sd_best));                                          \
+            macro_var(sd_hole) = macro_var(sd_best);                                                        \
+        }                                                                                                   \
+        (heap)->data[macro_var(sd_hole)] = macro_var(sd_value);                                             \
+        track((heap), macro_var(sd_hole), SIZE_MAX);                                                        \
+    } while (0)
+
+#define __sp_heap_untracked(heap, dst, src) ((void) 0)
+#define __sp_heap_sift_up(heap, __idx__, __value__, less) \
+    __sp_heap_sift_up_tracked((heap), (__idx__), (__value__), less, __sp_heap_untracked)
+#define __sp_heap_sift_down(heap, __idx__, __value__, less) \
+    __sp_heap_sift_down_tracked((heap), (__idx__), (__value__), less, __sp_heap_untracked)
+
+#define sp_heapify_up_by(heap, __idx__, less)                                                \
+    do {                                                                                     \
+        const size_t macro_var(hu_idx) = (__idx__);                                          \
+        __sp_heap_sift_up((heap), macro_var(hu_idx), (heap)->data[macro_var(hu_idx)], less); \
+    } while (0)
+
+/* Sifts the element at `__idx__` down until no child should be above it. */
+#define sp_heapify_down_by(heap, __idx__, less)                                                    \
+    do {                                                                                           \
+        const size_t macro_var(hd_idx) = (__idx__);                                                \
+        if (macro_var(hd_idx) < (heap)->count) {                                                   \
+            __sp_heap_sift_down((heap), macro_var(hd_idx), (heap)->data[macro_var(hd_idx)], less); \
+        }                                                                                          \
+    } while (0)
+
+#define sp_heapify_up(heap, __idx__) sp_heapify_up_by((heap), (__idx__), (heap)->cmp)
+#define sp_heapify_down(heap, __idx__) sp_heapify_down_by((heap), (__idx__), (heap)->cmp)
+#define sp_heapify(heap) sp_heapify_down((heap), 0)
+
+/* Restores the heap property over all of `data[0, count)` bottom-up (Floyd): every internal node is sifted down
+ * once, starting from the last one. O(count), against O(count log count) for pushing the elements one by one. */
+#define sp_heap_build_by(heap, less)                                                          \
+    do {                                                                                      \
+        if ((heap)->count < 2) break;                                                         \
+        for (size_t macro_var(build_idx) = sp_heap_parent_idx((heap), (heap)->count - 1) + 1; \
+             macro_var(build_idx)-- > 0;) {                                                   \
+            sp_heapify_down_by((heap), macro_var(build_idx), less);                           \
+        }                                                                                     \
     } while (0)
+#define sp_heap_build(heap) sp_heap_build_by((heap), (heap)->cmp)
 
 /*
  * NOTE: `sp_heap_top()` is unguarded; calling this on an empty/invalid heap is undefined behavior.
  */
 #define sp_heap_top(heap) (heap)->data[0]
 
-#define sp_heap_push(heap, __element__)                                                    \
-    do {                                                                                   \
-        const __typeof__(__element__) element = (__element__);                             \
-        if (!(heap)->cmp) {                                                                \
-            (heap)->cmp = _Generic(*(heap)->data, int: &sp_lesser_int_cmp, default: NULL); \
-        }                                                                                  \
-        if ((heap)->height == 0) {                                                         \
-            sp_bt_alloc((heap), SP_BT_INIT_HEIGHT);                                        \
-        } else if ((heap)->count >= sp_bt_capacity_from_height((heap)->height)) {          \
-            sp_bt_alloc((heap), (heap)->height + 1);                                       \
-        }                                                                                  \
-        (heap)->data[(heap)->count] = element;                                             \
-        sp_heapify_up(heap, (heap)->count++);                                              \
+#define sp_heap_push_by(heap, __element__, less)                                 \
+    do {                                                                         \
+        const __typeof__(*(heap)->data) macro_var(push_element) = (__element__); \
+        __sp_heap_reserve((heap), (heap)->count + 1);                            \
+        __sp_heap_sift_up((heap), (heap)->count, macro_var(push_element), less); \
+        ++(heap)->count;                                                         \
     } while (0)
 
-#define sp_heap_pop(heap)                                            \
-    do {                                                             \
-        if (!(heap)->data || (heap)->count == 0) break;              \
-        --(heap)->count;                                             \
-        sp_swap(&sp_heap_top((heap)), &(heap)->data[(heap)->count]); \
-        sp_heapify((heap));                                          \
-    } while (0)
-
-#define sp_heap_free(heap)      \
-    do {                        \
-        if ((heap)->data) {     \
-            free((heap)->data); \
-        }                       \
-        (heap)->data = NULL;    \
-        (heap)->count = 0;      \
-        (heap)->height = 0;     \
-        (heap)->cmp = NULL;     \
+#define sp_heap_push(heap, __element__)                      \
+    do {                                                     \
+        __sp_heap_default_cmp(heap);                         \
+        sp_heap_push_by((heap), (__element__), (heap)->cmp); \
+    } while (0)
+
+/* Moves the last element into the root's hole and sifts it down. */
+#define sp_heap_pop_by(heap, less)                                             \
+    do {                                                                       \
+        if (!(heap)->data || (heap)->count == 0) break;                        \
+        --(heap)->count;                                                       \
+        if ((heap)->count > 0) {                                               \
+            __sp_heap_sift_down((heap), 0, (heap)->data[(heap)->count], less); \
+        }                                                                      \
+    } while (0)
+#define sp_heap_pop(heap) sp_heap_pop_by((heap), (heap)->cmp)
+
+/*
+ * Builds the heap from `da` in O(n), taking over its buffer and allocator; `da` is left empty. `heap` must hold no
+ * storage (zero-initialized or freed), though its `cmp` may already be set. The buffer is resized once to the
+ * heap's storage size, in place when the allocator allows, and its elements are shifted onto the cache-line layout.
+ */
+#define sp_heap_from_array_by(heap, da, less)                                                                      \
+    do {                                                                                                           \
+        assert(!(heap)->data && "sp_heap_from_array() needs an empty heap");                                       \
+        size_t macro_var(fa_height) = SP_BT_INIT_HEIGHT;                                                           \
+        while (sp_bt_capacity_from_height(macro_var(fa_height)) < (da)->capacity) {                                \
+            ++macro_var(fa_height);                                                                                \
+        }                                                                                                          \
+        (heap)->allocator = (da)->allocator;                                                                       \
+        char *macro_var(fa_base) = sp_realloc((heap)->allocator, (da)->data, (da)->capacity * sizeof(*(da)->data), \
+                                              sp_bt_alloc_size(macro_var(fa_height), sizeof(*(heap)->data)));      \
+        (heap)->offset = __sp_bt_line_offset(macro_var(fa_base), sizeof(*(heap)->data));                           \
+        memmove(macro_var(fa_base) + (heap)->offset, macro_var(fa_base), (da)->count * sizeof(*(heap)->data));     \
+        (heap)->data = (void *) (macro_var(fa_base) + (heap)->offset);                                             \
+        (heap)->height = macro_var(fa_height);                                                                     \
+        (heap)->count = (da)->count;                                                                               \
+        (da)->data = NULL;                                                                                         \
+        (da)->count = (da)->capacity = 0;                                                                          \
+        sp_heap_build_by((heap), less);                                                                            \
+    } while (0)
+
+#define sp_heap_from_array(heap, da)                      \
+    do {                                                  \
+        __sp_heap_default_cmp(heap);                      \
+        sp_heap_from_array_by((heap), (da), (heap)->cmp); \
+    } while (0)
+
+/* Pushes `items[0, n)`. A batch at least as large as the heap is placed and then rebuilt in O(count + n);
+ * smaller ones are sifted up one at a time. */
+#define sp_heap_push_n_by(heap, items, n, less)                                                      \
+    do {                                                                                             \
+        const size_t macro_var(pn_n) = (n);                                                          \
+        if (macro_var(pn_n) == 0) break;                                                             \
+        __sp_heap_reserve((heap), (heap)->count + macro_var(pn_n));                                  \
+        memcpy((heap)->data + (heap)->count, (items), macro_var(pn_n) * sizeof(*(heap)->data));      \
+        if (macro_var(pn_n) >= (heap)->count) {                                                      \
+            (heap)->count += macro_var(pn_n);                                                        \
+            sp_heap_build_by((heap), less);                                                          \
+        } else {                                                                                     \
+            for (size_t macro_var(pn_i) = 0; macro_var(pn_i) < macro_var(pn_n); ++macro_var(pn_i)) { \
+                sp_heapify_up_by((heap), (heap)->count++, less);                                     \
+            }                                                                                        \
+        }                                                                                            \
+    } while (0)
+
+#define sp_heap_push_n(heap, items, n)                        \
+    do {                                                      \
+        __sp_heap_default_cmp(heap);                          \
+        sp_heap_push_n_by((heap), (items), (n), (heap)->cmp); \
+    } while (0)
+
+/* Pops the top and pushes `__element__` with a single sift, e.g. to keep the best K elements of a stream in a heap
+ * of size K whose top is the worst of them. Pushes if the heap is empty. */
+#define sp_heap_replace_top_by(heap, __element__, less)                        \
+    do {                                                                       \
+        const __typeof__(*(heap)->data) macro_var(rt_element) = (__element__); \
+        if ((heap)->count == 0) {                                              \
+            sp_heap_push_by((heap), macro_var(rt_element), less);              \
+        } else {                                                               \
+            __sp_heap_sift_down((heap), 0, macro_var(rt_element), less);       \
+        }                                                                      \
+    } while (0)
+
+#define sp_heap_replace_top(heap, __element__)                      \
+    do {                                                            \
+        __sp_heap_default_cmp(heap);                                \
+        sp_heap_replace_top_by((heap), (__element__), (heap)->cmp); \
+    } while (0)
+
+/*
+ * Heapsort in place: orders `data[0, count)` by `cmp`, top first, in O(count log count) without extra memory. A
+ * sorted array is itself a valid heap, so `heap` can keep being used afterwards.
+ */
+#define sp_heap_sort_by(heap, less)                                                                \
+    do {                                                                                           \
+        const size_t macro_var(sort_count) = (heap)->count;                                        \
+        while ((heap)->count > 1) {                                                                \
+            const __typeof__(*(heap)->data) macro_var(sort_top) = sp_heap_top(heap);               \
+            --(heap)->count;                                                                       \
+            __sp_heap_sift_down((heap), 0, (heap)->data[(heap)->count], less);                     \
+            (heap)->data[(heap)->count] = macro_var(sort_top);                                     \
+        }                                                                                          \
+        (heap)->count = macro_var(sort_count);                                                     \
+        /* Popping left the top last: reverse. */                                                  \
+        for (size_t macro_var(sort_i) = 0, macro_var(sort_j) = macro_var(sort_count);              \
+             macro_var(sort_j)-- > macro_var(sort_i) + 1; ++macro_var(sort_i)) {                   \
+            const __typeof__(*(heap)->data) macro_var(sort_tmp) = (heap)->data[macro_var(sort_i)]; \
+            (heap)->data[macro_var(sort_i)] = (heap)->data[macro_var(sort_j)];                     \
+            (heap)->data[macro_var(sort_j)] = macro_var(sort_tmp);                                 \
+        }                                                                                          \
+    } while (0)
+#define sp_heap_sort(heap) sp_heap_sort_by((heap), (heap)->cmp)
+
+#define sp_heap_free(heap)                                                     \
+    do {                                                                       \
+        if ((heap)->data) {                                                    \
+            sp_free((heap)->allocator, (char *) (heap)->data - (heap)->offset, \
+                    sp_bt_alloc_size((heap)->height, sizeof(*(heap)->data)));  \
+        }                                                                      \
+        (heap)->data = NULL;                                                   \
+        (heap)->count = 0;                                                     \
+        (heap)->height = 0;                                                    \
+        (heap)->offset = 0;                                                    \
+        (heap)->cmp = NULL;                                                    \
+    } while (0)
+
+/*
+ * Indexed heap: an `Sp_Heap` whose entries can be reprioritized or removed in O(log n) through the handle returned
+ * by push, e.g. Dijkstra's decrease-key or cancelling a scheduled deadline, instead of pushing duplicates and
+ * skipping stale ones on pop. `handles` maps each slot to its entry's handle and `slots` maps each handle back to
+ * its slot; both are kept up to date by the sift. Handles are dense and freed ones are reused by later pushes, so
+ * storage stays proportional to the most entries ever live at once. A handle is only valid until its entry is
+ * popped or removed.
+ *
+ * Ordering and arity work as for `Sp_Heap`, with the same `_by` forms. "Decrease" moves an entry towards the top,
+ * i.e. to a smaller key under the default `<` ordering.
+ */
+typedef uint32_t Sp_Heap_Handle;
+
+#define Sp_Indexed_Heap_D(T, D)                                            \
+    struct {                                                               \
+        T *data;                                                           \
+        Sp_Heap_Handle *handles;                                           \
+        Sp_Heap_Handle *slots;                                             \
+        size_t count;                                                      \
+        size_t height;                                                     \
+        Sp_Heap_Handle handle_count;                                       \
+        Sp_Heap_Handle free_head; /* first free handle + 1, 0 when none */ \
+        int (*cmp)(T, T);                                                  \
+        const Sp_Allocator *allocator;                                     \
+        size_t offset; /* bytes from the allocation to `data` */           \
+        char (*arity)[D]; /* never set: carries `D` only */                \
+    }
+#define Sp_Indexed_Heap(T) Sp_Indexed_Heap_D(T, 2)
+
+/* Free handles form a list through `slots`, each linking to the next free handle + 1. */
+static inline Sp_Heap_Handle __sp_iheap_acquire(Sp_Heap_Handle *slots, Sp_Heap_Handle *handle_count,
+                                                Sp_Heap_Handle *free_head) {
+    if (*free_head) {
+        const Sp_Heap_Handle handle = *free_head - 1;
+        *free_head = slots[handle];
+        return handle;
+    }
+    assert(*handle_count < UINT32_MAX && "Sp_Indexed_Heap ran out of handles");
+    return (*handle_count)++;
+}
+
+static inline void __sp_iheap_release(Sp_Heap_Handle *slots, Sp_Heap_Handle *free_head, Sp_Heap_Handle handle) {
+    slots[handle] = *free_head;
+    *free_head = handle + 1;
+}
+
+/* A free handle's link can look like a slot, but that slot then holds another live handle. */
+static inline int __sp_iheap_contains(const Sp_Heap_Handle *handles, const Sp_Heap_Handle *slots, size_t count,
+                                      Sp_Heap_Handle handle_count, Sp_Heap_Handle handle) {
+    return handle < handle_count && slots[handle] < count && handles[slots[handle]] == handle;
+}
+
+static inline void __sp_iheap_grow_index(const Sp_Allocator *allocator, Sp_Heap_Handle **handles,
+                                         Sp_Heap_Handle **slots, size_t old_capacity, size_t new_capacity) {
+    *handles = sp_realloc(allocator, *handles, old_capacity * sizeof(**handles), new_capacity * sizeof(**handles));
+    *slots = sp_realloc(allocator, *slots, old_capacity * sizeof(**slots), new_capacity * sizeof(**slots));
+}
+
+/* Grows `handles` and `slots` along with `data`: there are never more handles than the most entries ever held. */
+#define __sp_iheap_reserve(heap, __needed__)                                                              \
+    do {                                                                                                  \
+        const size_t macro_var(ir_old) = sp_bt_capacity_from_height((heap)->height);                      \
+        __sp_heap_reserve((heap), (__needed__));                                                          \
+        if (sp_bt_capacity_from_height((heap)->height) != macro_var(ir_old)) {                            \
+            __sp_iheap_grow_index((heap)->allocator, &(heap)->handles, &(heap)->slots, macro_var(ir_old), \
+                                  sp_bt_capacity_from_height((heap)->height));                            \
+        }                                                                                                 \
+    } while (0)
+
+/* Sift hook: the element moved into `dst` came from `src`, or is the one carried in `__sp_iheap_carried`. */
+#define __sp_iheap_track(heap, __dst__, __src__)                                                \
+    do {                                                                                        \
+        const size_t macro_var(it_dst) = (__dst__);                                             \
+        (heap)->handles[macro_var(it_dst)] =                                                    \
+            (__src__) == SIZE_MAX ? __sp_iheap_carried : (heap)->handles[(__src__)];            \
+        (heap)->slots[(heap)->handles[macro_var(it_dst)]] = (Sp_Heap_Handle) macro_var(it_dst); \
+    } while (0)
+
+/* Places `__value__`, the entry of handle `__sp_iheap_carried`, at the hole `__slot__`, sifting whichever way. */
+#define __sp_iheap_sift(heap, __slot__, __value__, less)                                                        \
+    do {                                                                                                        \
+        const size_t macro_var(is_slot) = (__slot__);                                                           \
+        const __typeof__(*(heap)->data) macro_var(is_value) = (__value__);                                      \
+        if (macro_var(is_slot) > 0 &&                                                                           \
+            less(macro_var(is_value), (heap)->data[sp_heap_parent_idx((heap), macro_var(is_slot))])) {          \
+            __sp_heap_sift_up_tracked((heap), macro_var(is_slot), macro_var(is_value), less, __sp_iheap_track); \
+        } else {                                                                                                \
+            __sp_heap_sift_down_tracked((heap), macro_var(is_slot), macro_var(is_value), less,                  \
+                                        __sp_iheap_track);                                                      \
+        }                                                                                                       \
+    } while (0)
+
+#define sp_iheap_contains(heap, handle) \
+    __sp_iheap_contains((heap)->handles, (heap)->slots, (heap)->count, (heap)->handle_count, (handle))
+
+/*
+ * NOTE: `sp_iheap_top()`, `sp_iheap_top_handle()` and `sp_iheap_get()` are unguarded; calling them on an empty heap
+ * or with a stale handle is undefined behavior.
+ */
+#define sp_iheap_top(heap) (heap)->data[0]
+#define sp_iheap_top_handle(heap) (heap)->handles[0]
+#define sp_iheap_get(heap, handle) (heap)->data[(heap)->slots[(handle)]]
+
+/* Pushes `__element__` and stores its handle in `*(handle_ptr)`. */
+#define sp_iheap_push_by(heap, __element__, handle_ptr, less)                                               \
+    do {                                                                                                    \
+        const __typeof__(*(heap)->data) macro_var(ipush_element) = (__element__);                           \
+        __sp_iheap_reserve((heap), (heap)->count + 1);                                                      \
+        const Sp_Heap_Handle __sp_iheap_carried =                                                           \
+            __sp_iheap_acquire((heap)->slots, &(heap)->handle_count, &(heap)->free_head);                   \
+        *(handle_ptr) = __sp_iheap_carried;                                                                 \
+        __sp_heap_sift_up_tracked((heap), (heap)->count, macro_var(ipush_element), less, __sp_iheap_track); \
+        ++(heap)->count;                                                                                    \
+    } while (0)
+
+#define sp_iheap_push(heap, __element__, handle_ptr)                        \
+    do {                                                                    \
+        __sp_heap_default_cmp(heap);                                        \
+        sp_iheap_push_by((heap), (__element__), (handle_ptr), (heap)->cmp); \
+    } while (0)
+
+/* Pops the top entry, freeing its handle. */
+#define sp_iheap_pop_by(heap, less)                                                                      \
+    do {                                                                                                 \
+        if (!(heap)->data || (heap)->count == 0) break;                                                  \
+        __sp_iheap_release((heap)->slots, &(heap)->free_head, (heap)->handles[0]);                       \
+        --(heap)->count;                                                                                 \
+        if ((heap)->count > 0) {                                                                         \
+            const Sp_Heap_Handle __sp_iheap_carried = (heap)->handles[(heap)->count];                    \
+            __sp_heap_sift_down_tracked((heap), 0, (heap)->data[(heap)->count], less, __sp_iheap_track); \
+        }                                                                                                \
+    } while (0)
+#define sp_iheap_pop(heap) sp_iheap_pop_by((heap), (heap)->cmp)
+
+/* Removes the entry of a live `handle` wherever it is, freeing the handle. */
+#define sp_iheap_remove_by(heap, handle, less)                                                      \
+    do {                                                                                            \
+        const Sp_Heap_Handle macro_var(irm_handle) = (handle);                                      \
+        assert(sp_iheap_contains((heap), macro_var(irm_handle)) && "stale Sp_Indexed_Heap handle"); \
+        const size_t macro_var(irm_slot) = (heap)->slots[macro_var(irm_handle)];                    \
+        __sp_iheap_release((heap)->slots, &(heap)->free_head, macro_var(irm_handle));               \
+        --(heap)->count;                                                                            \
+        if (macro_var(irm_slot) < (heap)->count) {                                                  \
+            const Sp_Heap_Handle __sp_iheap_carried = (heap)->handles[(heap)->count];               \
+            __sp_iheap_sift((heap), macro_var(irm_slot), (heap)->data[(heap)->count], less);        \
+        }                                                                                           \
+    } while (0)
+#define sp_iheap_remove(heap, handle) sp_iheap_remove_by((heap), (handle), (heap)->cmp)
+
+/* Replaces the entry of a live `handle` with `__element__`, which may belong higher or lower. */
+#define sp_iheap_update_by(heap, handle, __element__, less)                                      \
+    do {                                                                                         \
+        const Sp_Heap_Handle __sp_iheap_carried = (handle);                                      \
+        assert(sp_iheap_contains((heap), __sp_iheap_carried) && "stale Sp_Indexed_Heap handle"); \
+        __sp_iheap_sift((heap), (heap)->slots[__sp_iheap_carried], (__element__), less);         \
+    } while (0)
+#define sp_iheap_update(heap, handle, __element__) sp_iheap_update_by((heap), (handle), (__element__), (heap)->cmp)
+
+/* Replaces the entry of a live `handle` with `__element__`, which must not belong below it, and sifts it up. */
+#define sp_iheap_decrease_key_by(heap, handle, __element__, less)                                               \
+    do {                                                                                                        \
+        const Sp_Heap_Handle __sp_iheap_carried = (handle);                                                     \
+        assert(sp_iheap_contains((heap), __sp_iheap_carried) && "stale Sp_Indexed_Heap handle");                \
+        const size_t macro_var(idk_slot) = (heap)->slots[__sp_iheap_carried];                                   \
+        const __typeof__(*(heap)->data) macro_var(idk_element) = (__element__);                                 \
+        assert(!less((heap)->data[macro_var(idk_slot)], macro_var(idk_element)) && "key was increased");        \
+        __sp_heap_sift_up_tracked((heap), macro_var(idk_slot), macro_var(idk_element), less, __sp_iheap_track); \
+    } while (0)
+#define sp_iheap_decrease_key(heap, handle, __element__) \
+    sp_iheap_decrease_key_by((heap), (handle), (__element__), (heap)->cmp)
+
+/* Replaces the entry of a live `handle` with `__element__`, which must not belong above it, and sifts it down. */
+#define sp_iheap_increase_key_by(heap, handle, __element__, less)                                                 \
+    do {                                                                                                          \
+        const Sp_Heap_Handle __sp_iheap_carried = (handle);                                                       \
+        assert(sp_iheap_contains((heap), __sp_iheap_carried) && "stale Sp_Indexed_Heap handle");                  \
+        const size_t macro_var(iik_slot) = (heap)->slots[__sp_iheap_carried];                                     \
+        const __typeof__(*(heap)->data) macro_var(iik_element) = (__element__);                                   \
+        assert(!less(macro_var(iik_element), (heap)->data[macro_var(iik_slot)]) && "key was decreased");          \
+        __sp_heap_sift_down_tracked((heap), macro_var(iik_slot), macro_var(iik_element), less, __sp_iheap_track); \
+    } while (0)
+#define sp_iheap_increase_key(heap, handle, __element__) \
+    sp_iheap_increase_key_by((heap), (handle), (__element__), (heap)->cmp)
+
+#define sp_iheap_free(heap)                                                                                  \
+    do {                                                                                                     \
+        if ((heap)->data) {                                                                                  \
+            const size_t macro_var(iheap_capacity) = sp_bt_capacity_from_height((heap)->height);             \
+            sp_free((heap)->allocator, (char *) (heap)->data - (heap)->offset,                               \
+                    sp_bt_alloc_size((heap)->height, sizeof(*(heap)->data)));                                \
+            sp_free((heap)->allocator, (heap)->handles, macro_var(iheap_capacity) * sizeof(Sp_Heap_Handle)); \
+            sp_free((heap)->allocator, (heap)->slots, macro_var(iheap_capacity) * sizeof(Sp_Heap_Handle));   \
+        }                                                                                                    \
+        (heap)->data = NULL;                                                                                 \
+        (heap)->handles = (heap)->slots = NULL;                                                              \
+        (heap)->count = 0;                                                                                   \
+        (heap)->height = 0;                                                                                  \
+        (heap)->offset = 0;                                                                                  \
+        (heap)->handle_count = (heap)->free_head = 0;                                                        \
+        (heap)->cmp = NULL;                                                                                  \
     } while (0)
 
 #endif